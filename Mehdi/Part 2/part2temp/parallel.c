@@ -32,6 +32,9 @@ __declspec(dllexport) unsigned long NvOptimusEnablement = 0x00000001;    // NVID
 #include <math.h> // INFINITY
 #include <stdlib.h>
 #include <string.h>
+#ifdef _OPENMP
+#include <omp.h> // omp_get_max_threads
+#endif
 
 #include <CL/cl.h>
 
@@ -78,6 +81,240 @@ static cl_mem              d_id_b   =   NULL;
 static size_t              WGX      =   32;
 static size_t              WGY      =   32;
 
+// Shading kernels parallelGraphicsEngine can launch.
+// Override with e.g. -DSHADE_KERNEL=KERNEL_TABLE
+#define KERNEL_SHADE 0   // distances computed per pixel and satellite
+#define KERNEL_TABLE 1   // dx^2 / dy^2 tables per work-group in local memory
+#define KERNEL_VORONOI 2 // nearest-satellite map pass, then a weight-only pass
+#define KERNEL_GRID  3   // hit test and nearest satellite from the satellite cell grid
+#define KERNEL_STAMP 4   // colour pass without hit test, then discs stamped per satellite
+#define KERNEL_EXACT 5   // reference operation order, byte-identical (separate strict build)
+#define KERNEL_LOCAL 6   // satellites staged per work-group in local memory as float4
+#define KERNEL_CONSTANT 7 // satellites packed as float4 in a constant buffer
+#define KERNEL_BLOCKED 8 // SHADE_BLOCK_X x SHADE_BLOCK_Y pixels per work-item
+#ifndef SHADE_KERNEL
+#define SHADE_KERNEL KERNEL_SHADE
+#endif
+// Satellites per local-memory table refill of the table kernel
+#define TABLE_CHUNK 64
+// Satellites per local-memory refill of the local kernel (two float4 each)
+#define LOCAL_CHUNK 256
+// Pixels per work-item of the blocked kernel; a kernel build option, so the
+// benchmark builds its own program for every factor it compares
+#ifndef SHADE_BLOCK_X
+#define SHADE_BLOCK_X 4
+#endif
+#ifndef SHADE_BLOCK_Y
+#define SHADE_BLOCK_Y 1
+#endif
+
+// Set to 1 to time every shading kernel on the first frame against shade
+// and exit instead of opening the main loop.
+#ifndef BENCHMARK_KERNELS
+#define BENCHMARK_KERNELS 0
+#endif
+
+// Set to 1 to upload the satellites in Morton order of their positions
+// (MORTON_CELL pixel cells) so work-items of a tile read nearby satellites
+// from nearby addresses; identifiers are then uploaded every frame in the
+// same order. satOrder[k] is the satellites[] index in device slot k.
+#ifndef SORT_SATELLITES
+#define SORT_SATELLITES 0
+#endif
+#define MORTON_CELL 4
+#if SORT_SATELLITES
+static int                 satOrder[SATELLITE_COUNT];
+#endif
+
+static cl_kernel           clKerTable   = NULL;
+
+// Satellite staging: through local memory in chunks, or from one constant
+// buffer of packed satellites where it fits the device's constant memory
+static cl_kernel           clKerLocal    = NULL;
+static cl_kernel           clKerConstant = NULL;
+static cl_mem              d_sat_packed  = NULL;
+static int                 constantFits  = 0;
+
+// Blocked kernel and the factor it was built with
+static cl_kernel           clKerBlocked  = NULL;
+static int                 blockX        = SHADE_BLOCK_X;
+static int                 blockY        = SHADE_BLOCK_Y;
+
+// Nearest-satellite map: kernels, the per-pixel index map and the per
+// work-group candidate lists (CSR), which grow on demand
+static cl_kernel           clKerNearestMap   = NULL;
+static cl_kernel           clKerNearestShade = NULL;
+static cl_mem              d_nearest         = NULL;
+static cl_mem              d_tile_start      = NULL;
+static cl_mem              d_tile_cand       = NULL;
+static int*                h_tile_start      = NULL;
+static int*                h_tile_cand       = NULL;
+static size_t              tileCandCapacity  = 0;
+
+// Satellite cell grid (CSR), rebuilt every frame with a parallel counting
+// sort and uploaded next to the tile candidate lists. GRID_CELL exceeds
+// SATELLITE_RADIUS, so a disc only reaches the 3x3 cells around its own.
+#define GRID_CELL          32
+#define GRID_CELLS_X       ((WINDOW_WIDTH + GRID_CELL - 1) / GRID_CELL)
+#define GRID_CELLS_Y       ((WINDOW_HEIGHT + GRID_CELL - 1) / GRID_CELL)
+#define GRID_CELL_COUNT    (GRID_CELLS_X * GRID_CELLS_Y)
+#define GRID_SORT_CHUNKS   16
+static cl_kernel           clKerGrid    = NULL;
+static cl_mem              d_cell_start = NULL;
+static cl_mem              d_cell_list  = NULL;
+static int                 h_cell_start[GRID_CELL_COUNT + 1];
+static int                 h_cell_list[SATELLITE_COUNT];
+static int                 gridSortCount[GRID_SORT_CHUNKS][GRID_CELL_COUNT];
+static int                 gridCellOf[SATELLITE_COUNT];
+
+// Stamp renderer: colour pass without the hit test, then one work-item per
+// pixel of every satellite's bounding box stamps the discs
+static cl_kernel           clKerWeights = NULL;
+static cl_kernel           clKerStamp   = NULL;
+static int                 shadeKernel  = SHADE_KERNEL;
+
+// Exact kernel, in a second program built with strict float options
+static cl_program          clProgExact  = NULL;
+static cl_kernel           clKerExact   = NULL;
+
+// Progressive mode: after the validation frames the frame is drawn at 1/16
+// resolution first and refined in passes (sample steps 4, 2, 1) until
+// PROGRESSIVE_DEADLINE_MS has passed. Tiles nearest to a satellite or the
+// cursor go first; each pass is launched in PROGRESSIVE_CHUNKS pieces so the
+// deadline can be checked in between.
+#ifndef PROGRESSIVE_RENDERING
+#define PROGRESSIVE_RENDERING 0
+#endif
+#ifndef PROGRESSIVE_DEADLINE_MS
+#define PROGRESSIVE_DEADLINE_MS 16
+#endif
+#define PROGRESSIVE_TILE     32
+#define PROGRESSIVE_COARSEST 4
+#define PROGRESSIVE_PASSES   3
+#define PROGRESSIVE_CHUNKS   8
+#define PROGRESSIVE_TILES_X  ((WINDOW_WIDTH + PROGRESSIVE_TILE - 1) / PROGRESSIVE_TILE)
+#define PROGRESSIVE_TILES_Y  ((WINDOW_HEIGHT + PROGRESSIVE_TILE - 1) / PROGRESSIVE_TILE)
+#define PROGRESSIVE_TILE_COUNT (PROGRESSIVE_TILES_X * PROGRESSIVE_TILES_Y)
+
+static cl_kernel           clKerProg    = NULL;
+static cl_mem              d_tile_order = NULL;
+
+// Achieved quality of the last progressive frame: the pass every tile
+// finished, and the fraction of pixels that hold their exact value
+int                        progressiveQuality = 0;
+float                      progressiveExact   = 0.f;
+
+// Headless mode: init() runs the frame loop itself without presenting and
+// exits. The frame size is read at run time from the HEADLESS_WIDTH and
+// HEADLESS_HEIGHT environment variables (720p up to 8K, the window size when
+// unset), the frame count from HEADLESS_FRAMES.
+#ifndef HEADLESS
+#define HEADLESS 0
+#endif
+#define HEADLESS_MIN_WIDTH 1280
+#define HEADLESS_MIN_HEIGHT 720
+#define HEADLESS_MAX_WIDTH 7680
+#define HEADLESS_MAX_HEIGHT 4320
+#define HEADLESS_DEFAULT_FRAMES 100
+
+// Movie mode: init() renders MOVIE_FRAMES frames (from the environment) at
+// MOVIE_WIDTH x MOVIE_HEIGHT as a stream of binary PPM images to MOVIE_FILE
+// and exits, with up to MOVIE_QUEUE frames queued on the device at once.
+#ifndef MOVIE_RENDER
+#define MOVIE_RENDER 0
+#endif
+#define MOVIE_DEFAULT_FRAMES 300
+#define MOVIE_QUEUE 4
+
+// Display interpolation: after the validation frames physics runs on a
+// thread of its own at PHYSICS_RATE frames per second, and every displayed
+// frame is shaded from positions interpolated between the two newest
+// physics frames for the current time, or extrapolated from the newest one
+// while physics is late. Only the windowed loop is affected.
+#ifndef DISPLAY_INTERPOLATION
+#define DISPLAY_INTERPOLATION 0
+#endif
+#ifndef PHYSICS_RATE
+#define PHYSICS_RATE 30
+#endif
+// One in PHYSICS_THREAD_SHARE OpenMP threads steps the physics thread, the
+// rest run the main thread's loops, so the two teams do not compete for the
+// same cores
+#ifndef PHYSICS_THREAD_SHARE
+#define PHYSICS_THREAD_SHARE 4
+#endif
+#define INTERPOLATION_REPORT_INTERVAL 60
+
+// Same value as the errorCheck tolerance defined further below
+#define ALLOWED_ERROR 10
+
+// Camera: after the validation frames the view can be zoomed with the mouse
+// wheel or + and -, panned with the arrow keys by CAMERA_PAN pixels and
+// reset with 0. shade then gets only the satellites near the view and
+// interpolates the others from sums taken every CAMERA_CELL pixels on the
+// host, within CAMERA_ERROR_BUDGET colour steps.
+#ifndef CAMERA_VIEW
+#define CAMERA_VIEW 0
+#endif
+#define CAMERA_ZOOM_STEP 1.25f
+#define CAMERA_MIN_ZOOM 0.25f
+#define CAMERA_MAX_ZOOM 64.0f
+#define CAMERA_PAN 64
+#define CAMERA_CELL 16
+#define CAMERA_CELLS_X ((WINDOW_WIDTH + CAMERA_CELL - 1) / CAMERA_CELL)
+#define CAMERA_CELLS_Y ((WINDOW_HEIGHT + CAMERA_CELL - 1) / CAMERA_CELL)
+#define CAMERA_CORNERS ((CAMERA_CELLS_X + 1) * (CAMERA_CELLS_Y + 1))
+#define CAMERA_ERROR_BUDGET (ALLOWED_ERROR / 4.0f)
+#if CAMERA_VIEW && PROGRESSIVE_RENDERING
+#error "CAMERA_VIEW shades through its own path and cannot be combined with PROGRESSIVE_RENDERING"
+#endif
+
+// Zero-copy presentation: in the windowed loop pixels points straight at the
+// window surface, so every frame is read back from the device into the
+// memory that is presented and render() copies the buffer onto itself.
+// Needs a BGRX surface without row padding and keeps the own buffer
+// otherwise. correctPixels is released after the validation frames, so the
+// kernel benchmark, which replays frame numbers, cannot use the mode. Not
+// portable: a memcpy whose source and destination overlap is undefined in
+// C, so the mode is limited to glibc (see the section below).
+#ifndef ZERO_COPY_PRESENT
+#define ZERO_COPY_PRESENT 0
+#endif
+#if ZERO_COPY_PRESENT && !defined(__GLIBC__)
+#error "ZERO_COPY_PRESENT relies on glibc's memcpy handling render()'s copy of pixels onto itself"
+#endif
+#if ZERO_COPY_PRESENT && BENCHMARK_KERNELS
+#error "BENCHMARK_KERNELS replays the validation frames, whose reference ZERO_COPY_PRESENT releases"
+#endif
+
+// Present thread: in the windowed loop finished frames are handed through a
+// lock-free triple buffer to a thread of their own, which copies the newest
+// one into the window surface and updates the window. Read-back never waits
+// for the display and compute() no longer times presentation; the present
+// latency is printed every PRESENT_REPORT_INTERVAL presented frames.
+#ifndef PRESENT_THREAD
+#define PRESENT_THREAD 0
+#endif
+#define PRESENT_REPORT_INTERVAL 60
+#if PRESENT_THREAD && ZERO_COPY_PRESENT
+#error "PRESENT_THREAD reads back off-screen and cannot be combined with ZERO_COPY_PRESENT"
+#endif
+#if PRESENT_THREAD && defined(__APPLE__)
+#error "PRESENT_THREAD updates the window off the main thread, which macOS does not allow"
+#endif
+#if PRESENT_THREAD && !defined(__GLIBC__)
+#error "PRESENT_THREAD relies on glibc's memcpy handling render()'s copy of pixels onto itself"
+#endif
+
+static cl_kernel           clKerScaled  = NULL;
+
+// Defined with the frame loop further below
+extern unsigned int frameNumber;
+extern SDL_Window* win;
+extern SDL_Surface* surf;
+void compute(void);
+void sequentialGraphicsEngine();
+
 
 ////////////////////////////////////////////////
 //   ¤¤ LOAD KERNEL FILE USING MALLOC ¤¤      //
@@ -206,6 +443,60 @@ static void pickOpenCLDevice(void) {
 
 // ## You may add your own variables here ##
 
+void benchmarkKernels(void);
+void headlessRun(void);
+void movieRun(void);
+void attachSurfacePixels(void);
+void startPresentThread(void);
+void enableDisplayInterpolation(void);
+void startCameraControls(void);
+void cursorToWorld(void);
+
+// Options of the main kernel build
+#define FAST_BUILD_OPTIONS "-cl-fast-relaxed-math -cl-mad-enable -cl-unsafe-math-optimizations"
+
+// Builds the kernel file with the given options; prints the log on failure
+static cl_program buildProgram(const char* src, size_t srcLen, const char* options) {
+    cl_int err;
+    const char* srcs[] = { src }; const size_t lens[] = { srcLen };
+    cl_program prog = clCreateProgramWithSource(clCtx, 1, srcs, lens, &err); CL_CHECK(err);
+    err = clBuildProgram(prog, 1, &clDev, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        size_t logSize = 0; clGetProgramBuildInfo(prog, clDev, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
+        char* log = (char*)malloc(logSize + 1);
+        clGetProgramBuildInfo(prog, clDev, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
+        log[logSize] = '\0'; fprintf(stderr, "Build failed:\n%s\n", log); free(log);
+        CL_CHECK(err);
+    }
+    return prog;
+}
+
+#if SHADE_KERNEL == KERNEL_EXACT || BENCHMARK_KERNELS
+// shade_exact needs IEEE float semantics, so it comes from a second build
+// without the fast-math options and, where the device offers it, with
+// correctly rounded division and sqrt as on the host
+static void buildExactProgram(const char* src, size_t srcLen) {
+    cl_int err;
+    cl_device_fp_config fp = 0;
+    clGetDeviceInfo(clDev, CL_DEVICE_SINGLE_FP_CONFIG, sizeof(fp), &fp, NULL);
+    int rounded = (fp & CL_FP_CORRECTLY_ROUNDED_DIVIDE_SQRT) != 0;
+    if (!rounded) printf("Device has no correctly rounded division and sqrt, shade_exact may differ\n");
+    clProgExact = buildProgram(src, srcLen, rounded ? "-cl-fp32-correctly-rounded-divide-sqrt" : "");
+    clKerExact = clCreateKernel(clProgExact, "shade_exact", &err); CL_CHECK(err);
+}
+#endif
+
+// Compares the frame with sequentialGraphicsEngine byte for byte
+static void checkExactFrame(void) {
+    sequentialGraphicsEngine();
+    int differ = 0;
+    for (int i = 0; i < SIZE; ++i) {
+        differ += pixels[i].red != correctPixels[i].red || pixels[i].green != correctPixels[i].green ||
+                  pixels[i].blue != correctPixels[i].blue;
+    }
+    printf("Exact check in frame %u: %d of %d pixels differ from the reference\n", frameNumber, differ, SIZE);
+}
+
 // ## You may add your own initialization routines here ##
 void init(){
     // Pick device first
@@ -226,20 +517,29 @@ void init(){
     size_t srcLen = 0;
     char* src = loadTextFile("parallel.cl", &srcLen);
     if (!src) { fprintf(stderr, "Could not load parallel.cl\n"); exit(1); }
-    const char* srcs[] = { src }; const size_t lens[] = { srcLen };
-    clProg = clCreateProgramWithSource(clCtx, 1, srcs, lens, &err); CL_CHECK(err);
+    char buildOpts[256];
+    snprintf(buildOpts, sizeof(buildOpts), "%s -DBLOCK_X=%d -DBLOCK_Y=%d", FAST_BUILD_OPTIONS, blockX, blockY);
+    clProg = buildProgram(src, srcLen, buildOpts); // build from kernel file
+#if SHADE_KERNEL == KERNEL_EXACT || BENCHMARK_KERNELS
+    buildExactProgram(src, srcLen);
+#endif
     free(src);
 
-    const char* buildOpts = "-cl-fast-relaxed-math -cl-mad-enable -cl-unsafe-math-optimizations"; 
-    err = clBuildProgram(clProg, 1, &clDev, buildOpts, NULL, NULL); // build from kernel file
-    if (err != CL_SUCCESS) {
-        size_t logSize = 0; clGetProgramBuildInfo(clProg, clDev, CL_PROGRAM_BUILD_LOG, 0, NULL, &logSize);
-        char* log = (char*)malloc(logSize + 1);
-        clGetProgramBuildInfo(clProg, clDev, CL_PROGRAM_BUILD_LOG, logSize, log, NULL);
-        log[logSize] = '\0'; fprintf(stderr, "Build failed:\n%s\n", log); free(log);
-        CL_CHECK(err);
-    }
     clKer = clCreateKernel(clProg, "shade", &err); CL_CHECK(err);
+    clKerTable = clCreateKernel(clProg, "shade_table", &err); CL_CHECK(err);
+    clKerNearestMap = clCreateKernel(clProg, "nearest_map", &err); CL_CHECK(err);
+    clKerNearestShade = clCreateKernel(clProg, "shade_nearest", &err); CL_CHECK(err);
+    clKerGrid = clCreateKernel(clProg, "shade_grid", &err); CL_CHECK(err);
+    clKerWeights = clCreateKernel(clProg, "shade_weights", &err); CL_CHECK(err);
+    clKerStamp = clCreateKernel(clProg, "stamp_discs", &err); CL_CHECK(err);
+    clKerScaled = clCreateKernel(clProg, "shade_scaled", &err); CL_CHECK(err);
+    clKerLocal = clCreateKernel(clProg, "shade_local", &err); CL_CHECK(err);
+    clKerConstant = clCreateKernel(clProg, "shade_constant", &err); CL_CHECK(err);
+    clKerBlocked = clCreateKernel(clProg, "shade_blocked", &err); CL_CHECK(err);
+#if PROGRESSIVE_RENDERING
+    clKerProg = clCreateKernel(clProg, "shade_progressive", &err); CL_CHECK(err);
+    d_tile_order = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, PROGRESSIVE_TILE_COUNT * sizeof(int), NULL, &err); CL_CHECK(err);
+#endif
 
     // Buffers
     // pixels: write directly into host memory
@@ -266,6 +566,17 @@ void init(){
     CL_CHECK(clEnqueueWriteBuffer(clQ, d_id_g, CL_TRUE, 0, sizeof(h_id_g), h_id_g, 0, NULL, NULL));
     CL_CHECK(clEnqueueWriteBuffer(clQ, d_id_b, CL_TRUE, 0, sizeof(h_id_b), h_id_b, 0, NULL, NULL));
 
+    // shade_constant reads all satellites from one constant buffer
+    cl_ulong constSize = 0;
+    clGetDeviceInfo(clDev, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(constSize), &constSize, NULL);
+    constantFits = sizeof(cl_float4) * 2 * SATELLITE_COUNT <= constSize;
+    d_sat_packed = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(cl_float4) * 2 * SATELLITE_COUNT, NULL, &err); CL_CHECK(err);
+    if (!constantFits && shadeKernel == KERNEL_CONSTANT) {
+        printf("%d satellites exceed the %llu bytes of constant memory, using shade_local\n",
+               SATELLITE_COUNT, (unsigned long long)constSize);
+        shadeKernel = KERNEL_LOCAL;
+    }
+
     // print WG preference
     size_t pref = 0, maxWG = 0;
     size_t devMaxWG = 0;
@@ -273,19 +584,38 @@ void init(){
     clGetKernelWorkGroupInfo(clKer, clDev, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(pref), &pref, NULL);
     clGetKernelWorkGroupInfo(clKer, clDev, CL_KERNEL_WORK_GROUP_SIZE, sizeof(maxWG), &maxWG, NULL);
     printf("Preferred WG multiple: %zu | Kernel Max WG size: %zu | Device max WG size: %zu \n", pref, maxWG, devMaxWG);
+
+#if BENCHMARK_KERNELS
+    benchmarkKernels();
+    exit(0);
+#endif
+#if HEADLESS
+    headlessRun();
+    exit(0);
+#endif
+#if MOVIE_RENDER
+    movieRun();
+    exit(0);
+#endif
+#if ZERO_COPY_PRESENT
+    attachSurfacePixels();
+#endif
+#if PRESENT_THREAD
+    startPresentThread();
+#endif
+#if DISPLAY_INTERPOLATION
+    enableDisplayInterpolation();
+#endif
+#if CAMERA_VIEW
+    startCameraControls();
+#endif
 }
 
 
 
-// ## You are asked to make this code parallel ##
-// Physics engine loop. (This is called once a frame before graphics engine)
-// Moves the satellites based on gravity
-// This is done multiple times in a frame because the Euler integration
-// is not accurate enough to be done only once
-void parallelPhysicsEngine(void) {
-
-    int tmpMousePosX = mousePosX;
-    int tmpMousePosY = mousePosY;
+// Advances sats by one frame around a black hole at (tmpMousePosX, tmpMousePosY)
+// with a team of the given number of threads
+static void stepSatellites(satellite* sats, int tmpMousePosX, int tmpMousePosY, int threads) {
 
     // double precision required for accumulation inside this routine,
     // but float storage is ok outside these loops.
@@ -294,16 +624,16 @@ void parallelPhysicsEngine(void) {
 
     // Copy in (float -> double) once
     for (int idx = 0; idx < SATELLITE_COUNT; ++idx) {
-        tmpPosition[idx].x = satellites[idx].position.x;
-        tmpPosition[idx].y = satellites[idx].position.y;
-        tmpVelocity[idx].x = satellites[idx].velocity.x;
-        tmpVelocity[idx].y = satellites[idx].velocity.y;
+        tmpPosition[idx].x = sats[idx].position.x;
+        tmpPosition[idx].y = sats[idx].position.y;
+        tmpVelocity[idx].x = sats[idx].velocity.x;
+        tmpVelocity[idx].y = sats[idx].velocity.y;
     }
 
     const double dt = (double)DELTATIME / (double)PHYSICSUPDATESPERFRAME;
 
     int i;
-#pragma omp parallel for schedule(static) // or: schedule(static, 8)
+#pragma omp parallel for schedule(static) num_threads(threads) // or: schedule(static, 8)
     for (i = 0; i < SATELLITE_COUNT; ++i) {
 
         // Work in registers to avoid false sharing
@@ -343,11 +673,190 @@ void parallelPhysicsEngine(void) {
 
     // Copy back into float storage once
     for (int idx2 = 0; idx2 < SATELLITE_COUNT; ++idx2) {
-        satellites[idx2].position.x = (float)tmpPosition[idx2].x;
-        satellites[idx2].position.y = (float)tmpPosition[idx2].y;
-        satellites[idx2].velocity.x = (float)tmpVelocity[idx2].x;
-        satellites[idx2].velocity.y = (float)tmpVelocity[idx2].y;
+        sats[idx2].position.x = (float)tmpPosition[idx2].x;
+        sats[idx2].position.y = (float)tmpPosition[idx2].y;
+        sats[idx2].velocity.x = (float)tmpVelocity[idx2].x;
+        sats[idx2].velocity.y = (float)tmpVelocity[idx2].y;
+    }
+}
+
+
+////////////////////////////////////////////////
+//      ¤¤ DISPLAY-RATE INTERPOLATION ¤¤      //
+////////////////////////////////////////////////
+// The physics thread stamps every frame it finishes with the time it is due
+// on screen, one 1/PHYSICS_RATE period after the frame before (or when it
+// is done, if it is late), and starts the next frame as soon as the display
+// has moved past the older of the two newest frames. Each displayed frame
+// places the satellites on the cubic Hermite curve through the two newest
+// frames, with the velocities times DELTATIME (the simulated time between
+// two frames) as tangents. Past the newest frame they move on along its
+// velocity for at most one more period.
+
+static satellite* interpState[2];  // the two newest physics frames
+static Uint64 interpDue[2];        // when each of them is due on screen
+static satellite* physicsState;    // owned by the physics thread
+static SDL_mutex* interpLock;
+static SDL_Thread* physicsThread;
+static SDL_atomic_t physicsStop;
+static SDL_atomic_t physicsMouseX, physicsMouseY;
+static SDL_atomic_t physicsFrames;
+static int displayInterpolation = 0;
+static int ompTeam = 1;                       // OpenMP threads before the physics thread
+static int physicsTeam = 1, shadingTeam = 1;  // and while it runs
+static int interpShown, interpExtrapolated, interpLastPhysics;
+
+// Threads in a parallel region started on the calling thread
+static int ompThreads(void) {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
+
+static int SDLCALL physicsLoop(void* data) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 period = freq / PHYSICS_RATE;
+    (void)data;
+
+    for (;;) {
+        // interpDue is only written on this thread
+        Uint64 now = SDL_GetPerformanceCounter();
+        if (interpDue[0] > now) SDL_Delay((Uint32)((interpDue[0] - now) * 1000 / freq));
+        if (SDL_AtomicGet(&physicsStop)) break;
+
+        stepSatellites(physicsState, SDL_AtomicGet(&physicsMouseX), SDL_AtomicGet(&physicsMouseY), physicsTeam);
+        now = SDL_GetPerformanceCounter();
+        Uint64 due = interpDue[1] + period > now ? interpDue[1] + period : now;
+
+        SDL_LockMutex(interpLock);
+        satellite* oldest = interpState[0];
+        interpState[0] = interpState[1];
+        interpDue[0] = interpDue[1];
+        memcpy(oldest, physicsState, sizeof(satellite) * SATELLITE_COUNT);
+        interpState[1] = oldest;
+        interpDue[1] = due;
+        SDL_UnlockMutex(interpLock);
+        SDL_AtomicAdd(&physicsFrames, 1);
+    }
+    return 0;
+}
+
+static int startPhysicsThread(void) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    for (int k = 0; k < 2; ++k) {
+        interpState[k] = (satellite*)malloc(sizeof(satellite) * SATELLITE_COUNT);
+        memcpy(interpState[k], satellites, sizeof(satellite) * SATELLITE_COUNT);
+    }
+    physicsState = (satellite*)malloc(sizeof(satellite) * SATELLITE_COUNT);
+    memcpy(physicsState, satellites, sizeof(satellite) * SATELLITE_COUNT);
+    interpDue[0] = now - SDL_GetPerformanceFrequency() / PHYSICS_RATE;
+    interpDue[1] = now;
+    SDL_AtomicSet(&physicsMouseX, mousePosX);
+    SDL_AtomicSet(&physicsMouseY, mousePosY);
+
+    ompTeam = ompThreads();
+    physicsTeam = ompTeam / PHYSICS_THREAD_SHARE > 1 ? ompTeam / PHYSICS_THREAD_SHARE : 1;
+    shadingTeam = ompTeam - physicsTeam > 1 ? ompTeam - physicsTeam : 1;
+
+    interpLock = SDL_CreateMutex();
+    if (interpLock) physicsThread = SDL_CreateThread(physicsLoop, "physics", NULL);
+    if (!physicsThread) {
+        printf("Physics thread unavailable (%s), stepping physics every frame\n", SDL_GetError());
+        return 0;
     }
+#ifdef _OPENMP
+    omp_set_num_threads(shadingTeam);
+#endif
+    printf("Display interpolation: physics runs at %d frames per second on its own thread with %d threads, %d threads on the main thread\n",
+           PHYSICS_RATE, physicsTeam, shadingTeam);
+    return 1;
+}
+
+// Writes the satellite positions for the current time into satellites
+static void interpolateSatellites(void) {
+    SDL_AtomicSet(&physicsMouseX, mousePosX);
+    SDL_AtomicSet(&physicsMouseY, mousePosY);
+    double now = (double)SDL_GetPerformanceCounter();
+
+    SDL_LockMutex(interpLock);
+    const satellite* a = interpState[0];
+    const satellite* b = interpState[1];
+    float u = (float)((now - (double)interpDue[0]) / ((double)interpDue[1] - (double)interpDue[0]));
+    u = u > 0.f ? u : 0.f;
+    if (u <= 1.f) {
+        float u2 = u * u, u3 = u2 * u;
+        float h00 = 2.f * u3 - 3.f * u2 + 1.f, h01 = 3.f * u2 - 2.f * u3;
+        float h10 = (u3 - 2.f * u2 + u) * DELTATIME, h11 = (u3 - u2) * DELTATIME;
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            satellites[j].position.x = h00 * a[j].position.x + h10 * a[j].velocity.x +
+                                       h01 * b[j].position.x + h11 * b[j].velocity.x;
+            satellites[j].position.y = h00 * a[j].position.y + h10 * a[j].velocity.y +
+                                       h01 * b[j].position.y + h11 * b[j].velocity.y;
+            satellites[j].velocity = b[j].velocity;
+        }
+    } else {
+        float s = (u < 2.f ? u - 1.f : 1.f) * DELTATIME;
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            satellites[j].position.x = b[j].position.x + s * b[j].velocity.x;
+            satellites[j].position.y = b[j].position.y + s * b[j].velocity.y;
+            satellites[j].velocity = b[j].velocity;
+        }
+        ++interpExtrapolated;
+    }
+    SDL_UnlockMutex(interpLock);
+
+    if (++interpShown == INTERPOLATION_REPORT_INTERVAL) {
+        int physics = SDL_AtomicGet(&physicsFrames);
+        printf("Display interpolation: %d physics frames for %d displayed frames, %d extrapolated\n",
+               physics - interpLastPhysics, interpShown, interpExtrapolated);
+        interpLastPhysics = physics;
+        interpShown = interpExtrapolated = 0;
+    }
+}
+
+// Only the windowed loop interpolates; the offline modes step every frame
+void enableDisplayInterpolation(void) {
+    displayInterpolation = 1;
+}
+
+static void stopPhysicsThread(void) {
+    if (physicsThread) {
+        SDL_AtomicSet(&physicsStop, 1);
+        SDL_WaitThread(physicsThread, NULL);
+        physicsThread = NULL;
+#ifdef _OPENMP
+        omp_set_num_threads(ompTeam);
+#endif
+    }
+    if (interpLock) SDL_DestroyMutex(interpLock);
+    interpLock = NULL;
+    free(interpState[0]);
+    free(interpState[1]);
+    free(physicsState);
+    interpState[0] = interpState[1] = physicsState = NULL;
+}
+
+
+// ## You are asked to make this code parallel ##
+// Physics engine loop. (This is called once a frame before graphics engine)
+// Moves the satellites based on gravity
+// This is done multiple times in a frame because the Euler integration
+// is not accurate enough to be done only once
+void parallelPhysicsEngine(void) {
+#if CAMERA_VIEW
+    if (frameNumber >= 2) cursorToWorld();
+#endif
+    // Validation frames step the simulation in lockstep with the reference
+    if (displayInterpolation && frameNumber >= 2) {
+        if (physicsThread || startPhysicsThread()) {
+            interpolateSatellites();
+            return;
+        }
+        displayInterpolation = 0;
+    }
+    stepSatellites(satellites, mousePosX, mousePosY, ompThreads());
 }
 
 
@@ -445,16 +954,807 @@ void parallelPhysicsEngine(void) {
 
 
 
-void parallelGraphicsEngine(void) {
+////////////////////////////////////////////////
+//    ¤¤ PROGRESSIVE COARSE-TO-FINE MODE ¤¤   //
+////////////////////////////////////////////////
+#if PROGRESSIVE_RENDERING
+
+static float progressiveKey[PROGRESSIVE_TILE_COUNT];
+
+static int compareProgressiveKey(const void* a, const void* b) {
+    float ka = progressiveKey[*(const int*)a];
+    float kb = progressiveKey[*(const int*)b];
+    return (ka > kb) - (ka < kb);
+}
+
+// Squared distance from a point to the nearest pixel of a tile
+static float tileDistance2(float px, float py, int tile) {
+    float x0 = (float)((tile % PROGRESSIVE_TILES_X) * PROGRESSIVE_TILE);
+    float y0 = (float)((tile / PROGRESSIVE_TILES_X) * PROGRESSIVE_TILE);
+    float dx = fmaxf(fmaxf(x0 - px, px - (x0 + PROGRESSIVE_TILE - 1)), 0.f);
+    float dy = fmaxf(fmaxf(y0 - py, py - (y0 + PROGRESSIVE_TILE - 1)), 0.f);
+    return dx * dx + dy * dy;
+}
+
+// Runs the refinement passes into d_pixels. clKerProg must already have its
+// first 13 arguments (the same as clKer) set for this frame.
+static void progressiveShade(const float* h_pos_x, const float* h_pos_y, int mx, int my) {
+    Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 deadline = SDL_GetPerformanceCounter() + freq * PROGRESSIVE_DEADLINE_MS / 1000;
+
+    // Same order in every pass, so the tiles refined by a pass are always a
+    // prefix of the tiles refined by the pass before it
+    int order[PROGRESSIVE_TILE_COUNT];
+    for (int t = 0; t < PROGRESSIVE_TILE_COUNT; ++t) {
+        float key = tileDistance2((float)mx, (float)my, t);
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            key = fminf(key, tileDistance2(h_pos_x[j], h_pos_y[j], t));
+        }
+        progressiveKey[t] = key;
+        order[t] = t;
+    }
+    qsort(order, PROGRESSIVE_TILE_COUNT, sizeof(int), compareProgressiveKey);
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_tile_order, CL_FALSE, 0, sizeof(order), order, 0, NULL, NULL));
+
+    int tileSize = PROGRESSIVE_TILE, tilesX = PROGRESSIVE_TILES_X, coarsest = PROGRESSIVE_COARSEST;
+    CL_CHECK(clSetKernelArg(clKerProg, 13, sizeof(cl_mem), &d_tile_order));
+    CL_CHECK(clSetKernelArg(clKerProg, 15, sizeof(int), &tileSize));
+    CL_CHECK(clSetKernelArg(clKerProg, 16, sizeof(int), &tilesX));
+    CL_CHECK(clSetKernelArg(clKerProg, 18, sizeof(int), &coarsest));
+
+    const int chunk = (PROGRESSIVE_TILE_COUNT + PROGRESSIVE_CHUNKS - 1) / PROGRESSIVE_CHUNKS;
+    int refined[PROGRESSIVE_PASSES] = { 0 };  // tiles finished by each pass
+    Uint64 chunkCost = 0;                     // duration of the last chunk
+    int quality = 0;
+
+    for (int pass = 0; pass < PROGRESSIVE_PASSES; ++pass) {
+        int step = PROGRESSIVE_COARSEST >> pass;
+        int limit = pass == 0 ? PROGRESSIVE_TILE_COUNT : refined[pass - 1];
+        CL_CHECK(clSetKernelArg(clKerProg, 17, sizeof(int), &step));
+
+        while (refined[pass] < limit) {
+            Uint64 now = SDL_GetPerformanceCounter();
+            // The first pass always completes; later chunks only start if
+            // the last one's duration still fits before the deadline
+            if (pass > 0 && now + chunkCost > deadline) break;
+
+            int base = refined[pass];
+            int count = limit - base < chunk ? limit - base : chunk;
+            size_t local[2] = { PROGRESSIVE_TILE / step, PROGRESSIVE_TILE / step };
+            size_t global[2] = { (size_t)count * local[0], local[1] };
+            CL_CHECK(clSetKernelArg(clKerProg, 14, sizeof(int), &base));
+            CL_CHECK(clEnqueueNDRangeKernel(clQ, clKerProg, 2, NULL, global, local, 0, NULL, NULL));
+            CL_CHECK(clFinish(clQ));
+
+            chunkCost = SDL_GetPerformanceCounter() - now;
+            refined[pass] += count;
+        }
+        if (refined[pass] < PROGRESSIVE_TILE_COUNT) break;
+        quality = pass + 1;
+    }
+
+    // Window dimensions are multiples of PROGRESSIVE_TILE
+    double exact = 0.0;
+    for (int pass = 0; pass < PROGRESSIVE_PASSES; ++pass) {
+        int finer = pass + 1 < PROGRESSIVE_PASSES ? refined[pass + 1] : 0;
+        int step = PROGRESSIVE_COARSEST >> pass;
+        exact += (double)(refined[pass] - finer) * (PROGRESSIVE_TILE / step) * (PROGRESSIVE_TILE / step);
+    }
+    progressiveQuality = quality;
+    progressiveExact = (float)(exact / (SIZE));
+    printf("Progressive: pass %d/%d complete, %.1f%% of pixels exact\n",
+           progressiveQuality, PROGRESSIVE_PASSES, 100.0f * progressiveExact);
+}
+#endif
+
+
+////////////////////////////////////////////////
+//      ¤¤ NEAREST-SATELLITE MAP PASS ¤¤      //
+////////////////////////////////////////////////
+
+// Bins the satellites into GRID_CELL cells (clamped to the grid) with a
+// parallel counting sort: every chunk of satellites counts per cell, a scan
+// over (cell, chunk) gives each chunk its own write offsets, and the scatter
+// keeps every cell's list in ascending index order.
+static void buildSatelliteGrid(const float* h_pos_x, const float* h_pos_y) {
+    const int chunkSize = (SATELLITE_COUNT + GRID_SORT_CHUNKS - 1) / GRID_SORT_CHUNKS;
+    int chunk;
+
+#pragma omp parallel for schedule(static)
+    for (chunk = 0; chunk < GRID_SORT_CHUNKS; ++chunk) {
+        int* count = gridSortCount[chunk];
+        int end = (chunk + 1) * chunkSize < SATELLITE_COUNT ? (chunk + 1) * chunkSize : SATELLITE_COUNT;
+        memset(count, 0, sizeof(int) * GRID_CELL_COUNT);
+        for (int j = chunk * chunkSize; j < end; ++j) {
+            int cx = (int)floorf(h_pos_x[j] / GRID_CELL);
+            int cy = (int)floorf(h_pos_y[j] / GRID_CELL);
+            cx = cx < 0 ? 0 : (cx >= GRID_CELLS_X ? GRID_CELLS_X - 1 : cx);
+            cy = cy < 0 ? 0 : (cy >= GRID_CELLS_Y ? GRID_CELLS_Y - 1 : cy);
+            gridCellOf[j] = cy * GRID_CELLS_X + cx;
+            count[gridCellOf[j]]++;
+        }
+    }
+
+    // Exclusive scan; the counts become each chunk's first slot in a cell
+    int offset = 0;
+    for (int c = 0; c < GRID_CELL_COUNT; ++c) {
+        h_cell_start[c] = offset;
+        for (int k = 0; k < GRID_SORT_CHUNKS; ++k) {
+            int n = gridSortCount[k][c];
+            gridSortCount[k][c] = offset;
+            offset += n;
+        }
+    }
+    h_cell_start[GRID_CELL_COUNT] = offset;
+
+#pragma omp parallel for schedule(static)
+    for (chunk = 0; chunk < GRID_SORT_CHUNKS; ++chunk) {
+        int* slot = gridSortCount[chunk];
+        int end = (chunk + 1) * chunkSize < SATELLITE_COUNT ? (chunk + 1) * chunkSize : SATELLITE_COUNT;
+        for (int j = chunk * chunkSize; j < end; ++j) h_cell_list[slot[gridCellOf[j]]++] = j;
+    }
+}
+
+// Fills h_tile_start / h_tile_cand for work-group tiles of WGX x WGY pixels:
+// every satellite whose distance to the tile is within the smallest
+// farthest-pixel distance of any satellite, in ascending index order.
+// The search walks rings of grid cells around the tile; cells in ring k are
+// more than (k - 1) * GRID_CELL away from it.
+static void buildTileCandidates(const float* h_pos_x, const float* h_pos_y, int tilesX, int tilesY) {
+    const int maxRing = GRID_CELLS_X > GRID_CELLS_Y ? GRID_CELLS_X : GRID_CELLS_Y;
+    int count = 0;
+    for (int t = 0; t < tilesX * tilesY; ++t) {
+        float x0 = (float)((t % tilesX) * WGX), y0 = (float)((t / tilesX) * WGY);
+        float x1 = x0 + WGX - 1, y1 = y0 + WGY - 1;
+        int cx0 = (int)x0 / GRID_CELL, cy0 = (int)y0 / GRID_CELL;
+        int cx1 = (int)x1 / GRID_CELL, cy1 = (int)y1 / GRID_CELL;
+        cx1 = cx1 < GRID_CELLS_X ? cx1 : GRID_CELLS_X - 1;
+        cy1 = cy1 < GRID_CELLS_Y ? cy1 : GRID_CELLS_Y - 1;
+
+        float reach2 = INFINITY;
+        h_tile_start[t] = count;
+        for (int pass = 0; pass < 2; ++pass) {
+            for (int k = 0; k <= maxRing; ++k) {
+                float gap = (float)((k - 1) * GRID_CELL);
+                if (k > 0 && gap * gap > reach2) break;
+                for (int cy = cy0 - k; cy <= cy1 + k; ++cy) {
+                    if (cy < 0 || cy >= GRID_CELLS_Y) continue;
+                    int edge = k == 0 || cy == cy0 - k || cy == cy1 + k;
+                    int stride = edge ? 1 : cx1 - cx0 + 2 * k;
+                    for (int cx = cx0 - k; cx <= cx1 + k; cx += stride) {
+                        if (cx < 0 || cx >= GRID_CELLS_X) continue;
+                        int c = cy * GRID_CELLS_X + cx;
+                        for (int s = h_cell_start[c]; s < h_cell_start[c + 1]; ++s) {
+                            int j = h_cell_list[s];
+                            if (pass == 0) {
+                                float fx = fmaxf(h_pos_x[j] - x0, x1 - h_pos_x[j]);
+                                float fy = fmaxf(h_pos_y[j] - y0, y1 - h_pos_y[j]);
+                                reach2 = fminf(reach2, fx * fx + fy * fy);
+                                continue;
+                            }
+                            float dx = fmaxf(fmaxf(x0 - h_pos_x[j], h_pos_x[j] - x1), 0.f);
+                            float dy = fmaxf(fmaxf(y0 - h_pos_y[j], h_pos_y[j] - y1), 0.f);
+                            if (dx * dx + dy * dy > reach2) continue;
+                            if ((size_t)count == tileCandCapacity) {
+                                tileCandCapacity = tileCandCapacity ? 2 * tileCandCapacity : 4096;
+                                h_tile_cand = (int*)realloc(h_tile_cand, sizeof(int) * tileCandCapacity);
+                                if (d_tile_cand) { clReleaseMemObject(d_tile_cand); d_tile_cand = NULL; }
+                            }
+                            int i = count++;
+                            while (i > h_tile_start[t] && h_tile_cand[i - 1] > j) {
+                                h_tile_cand[i] = h_tile_cand[i - 1];
+                                --i;
+                            }
+                            h_tile_cand[i] = j;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    h_tile_start[tilesX * tilesY] = count;
+}
+
+// Checks the grid lookups against a full search over all satellites: the
+// nearest satellite of every pixel must be in its tile's candidate list, and
+// every disc covering a pixel must be binned in the 3x3 cells around it.
+// The kernels scan both lists in ascending index order, so this makes their
+// result the same as the full loop's.
+static void checkGridLists(const float* h_pos_x, const float* h_pos_y, int tilesX) {
+    const float sat_r2 = SATELLITE_RADIUS * SATELLITE_RADIUS;
+    int nearestErrors = 0, hitErrors = 0;
+    int i;
+#pragma omp parallel for schedule(static) reduction(+:nearestErrors, hitErrors)
+    for (i = 0; i < SIZE; ++i) {
+        int x = i % WINDOW_WIDTH, y = i / WINDOW_WIDTH;
+        int cx = x / GRID_CELL, cy = y / GRID_CELL;
+        float best = INFINITY;
+        int nearest = 0;
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            float dx = (float)x - h_pos_x[j];
+            float dy = (float)y - h_pos_y[j];
+            float d2 = dx * dx + dy * dy;
+            if (d2 < best) { best = d2; nearest = j; }
+            if (d2 < sat_r2) {
+                int ox = gridCellOf[j] % GRID_CELLS_X - cx, oy = gridCellOf[j] / GRID_CELLS_X - cy;
+                hitErrors += ox < -1 || ox > 1 || oy < -1 || oy > 1;
+            }
+        }
+        int t = (y / (int)WGY) * tilesX + x / (int)WGX;
+        int found = 0;
+        for (int c = h_tile_start[t]; c < h_tile_start[t + 1]; ++c) found |= h_tile_cand[c] == nearest;
+        nearestErrors += !found;
+    }
+    printf("Grid list check in frame %u: nearest satellite missing in %d, disc missing in %d of %d pixels\n",
+           frameNumber, nearestErrors, hitErrors, SIZE);
+}
+
+// Bins the satellites, derives the tile candidate lists from the bins and
+// uploads both CSR structures (positions are already in d_pos_x / d_pos_y)
+static void uploadGridLists(const float* h_pos_x, const float* h_pos_y, int tilesX, int tilesY) {
+    cl_int err;
+    if (!d_cell_start) {
+        d_cell_start = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(h_cell_start), NULL, &err); CL_CHECK(err);
+        d_cell_list = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(h_cell_list), NULL, &err); CL_CHECK(err);
+        d_tile_start = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(int) * (tilesX * tilesY + 1), NULL, &err); CL_CHECK(err);
+        h_tile_start = (int*)malloc(sizeof(int) * (tilesX * tilesY + 1));
+    }
+
+    buildSatelliteGrid(h_pos_x, h_pos_y);
+    buildTileCandidates(h_pos_x, h_pos_y, tilesX, tilesY);
+    if (frameNumber < 2) checkGridLists(h_pos_x, h_pos_y, tilesX);
+
+    if (!d_tile_cand) {
+        d_tile_cand = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(int) * tileCandCapacity, NULL, &err); CL_CHECK(err);
+    }
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_cell_start, CL_FALSE, 0, sizeof(h_cell_start), h_cell_start, 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_cell_list, CL_FALSE, 0, sizeof(h_cell_list), h_cell_list, 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_tile_start, CL_FALSE, 0, sizeof(int) * (tilesX * tilesY + 1), h_tile_start, 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_tile_cand, CL_FALSE, 0, sizeof(int) * h_tile_start[tilesX * tilesY], h_tile_cand, 0, NULL, NULL));
+}
+
+// Computes d_nearest for the current positions (already in d_pos_x / d_pos_y)
+static void nearestMapPass(const float* h_pos_x, const float* h_pos_y, size_t g0, size_t g1) {
+    cl_int err;
+    int tilesX = (int)(g0 / WGX), tilesY = (int)(g1 / WGY);
+    if (!d_nearest) {
+        d_nearest = clCreateBuffer(clCtx, CL_MEM_READ_WRITE, sizeof(int) * SIZE, NULL, &err); CL_CHECK(err);
+    }
+    uploadGridLists(h_pos_x, h_pos_y, tilesX, tilesY);
+
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    int arg = 0;
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(cl_mem), &d_nearest));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(cl_mem), &d_pos_x));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(cl_mem), &d_pos_y));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(cl_mem), &d_tile_start));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(cl_mem), &d_tile_cand));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(width), &width));
+    CL_CHECK(clSetKernelArg(clKerNearestMap, arg++, sizeof(height), &height));
+
+    size_t local[2] = { WGX, WGY };
+    size_t global[2] = { g0, g1 };
+    CL_CHECK(clEnqueueNDRangeKernel(clQ, clKerNearestMap, 2, NULL, global, local, 0, NULL, NULL));
+}
+
+
+// Stamps the satellite discs into d_pixels after the shade_weights pass
+static void stampDiscs(float bh_r2, float sat_r2, int mx, int my) {
+    // ceil(s - r) .. floor(s + r) spans at most 2 * floor(r) + 2 pixels
+    int   box = 2 * (int)SATELLITE_RADIUS + 2;
+    float radius = SATELLITE_RADIUS;
+    int   satCount = SATELLITE_COUNT, width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    int   arg = 0;
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(cl_mem), &d_pixels));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(cl_mem), &d_pos_x));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(cl_mem), &d_pos_y));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(satCount), &satCount));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(width), &width));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(height), &height));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(bh_r2), &bh_r2));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(sat_r2), &sat_r2));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(mx), &mx));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(my), &my));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(radius), &radius));
+    CL_CHECK(clSetKernelArg(clKerStamp, arg++, sizeof(box), &box));
+
+    size_t local = 64;
+    size_t global = ((size_t)SATELLITE_COUNT * box * box + local - 1) / local * local;
+    CL_CHECK(clEnqueueNDRangeKernel(clQ, clKerStamp, 1, NULL, &global, &local, 0, NULL, NULL));
+}
+
+
+#if SORT_SATELLITES
+// Spreads the low 9 bits of v to the even bit positions
+static unsigned spreadBits(unsigned v) {
+    v &= 0x1FF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Morton code of a position on a 512 x 512 grid of MORTON_CELL cells, which
+// covers the window; positions outside are clamped to the border cells
+static unsigned mortonKey(float x, float y) {
+    int cx = (int)floorf(x / MORTON_CELL), cy = (int)floorf(y / MORTON_CELL);
+    cx = cx < 0 ? 0 : (cx > 511 ? 511 : cx);
+    cy = cy < 0 ? 0 : (cy > 511 ? 511 : cy);
+    return spreadBits((unsigned)cx) | (spreadBits((unsigned)cy) << 1);
+}
+
+// Fills satOrder with a stable LSD radix sort (two 9-bit digits) of the
+// Morton keys, so satellites sharing a cell keep their satellites[] order
+static void sortSatellitesSpatially(void) {
+    static unsigned key[SATELLITE_COUNT];
+    static int from[SATELLITE_COUNT];
+    int count[512 + 1];
+
+    for (int j = 0; j < SATELLITE_COUNT; ++j) {
+        key[j] = mortonKey(satellites[j].position.x, satellites[j].position.y);
+        from[j] = j;
+    }
+    for (int shift = 0; shift < 18; shift += 9) {
+        memset(count, 0, sizeof(count));
+        for (int k = 0; k < SATELLITE_COUNT; ++k) count[((key[from[k]] >> shift) & 511) + 1]++;
+        for (int d = 0; d < 512; ++d) count[d + 1] += count[d];
+        for (int k = 0; k < SATELLITE_COUNT; ++k) satOrder[count[(key[from[k]] >> shift) & 511]++] = from[k];
+        memcpy(from, satOrder, sizeof(from));
+    }
+}
+#endif
+
+
+////////////////////////////////////////////////
+//        ¤¤ ZERO-COPY PRESENTATION ¤¤        //
+////////////////////////////////////////////////
+// Window surfaces of the SDL2 framebuffer backends never need locking and
+// keep their contents between frames. render() is fixed code, so its memcpy
+// stays and copies pixels onto itself. The C standard leaves that undefined;
+// glibc's memcpy copies equal ranges harmlessly (its x86-64 versions return
+// at once), other C libraries, MSVC's among them, make no such promise, so
+// other targets refuse ZERO_COPY_PRESENT at compile time.
+
+static int zeroCopyAttached = 0;
+
+void attachSurfacePixels(void) {
+    Uint32 format = surf ? surf->format->format : SDL_PIXELFORMAT_UNKNOWN;
+    if (!surf || SDL_MUSTLOCK(surf) || surf->pitch != WINDOW_WIDTH * (int)sizeof(color_u8) ||
+        (format != SDL_PIXELFORMAT_RGB888 && format != SDL_PIXELFORMAT_ARGB8888)) {
+        printf("Zero-copy presentation unavailable (%s, pitch %d), reading back into own buffer\n",
+               SDL_GetPixelFormatName(format), surf ? surf->pitch : 0);
+        return;
+    }
+    free(pixels);
+    pixels = (color_u8*)surf->pixels;
+    zeroCopyAttached = 1;
+    printf("Zero-copy presentation: reading back into the %s window surface\n", SDL_GetPixelFormatName(format));
+}
+
+#if ZERO_COPY_PRESENT
+// The reference frame is only needed by the two validation frames
+static void releaseValidationBuffer(void) {
+    free(correctPixels);
+    correctPixels = NULL;
+}
+
+// Leaves fixedDestroy a pixels pointer it may free
+static void detachSurfacePixels(void) {
+    if (zeroCopyAttached) pixels = NULL;
+    zeroCopyAttached = 0;
+}
+#endif
+
+
+////////////////////////////////////////////////
+//         ¤¤ DECOUPLED PRESENT THREAD ¤¤     //
+////////////////////////////////////////////////
+// pixels rotates through three buffers: the one read back into, the newest
+// finished one (the ready slot) and the one the present thread shows.
+// Publishing and taking a frame are single atomic exchanges of the ready
+// slot, whose PRESENT_FRESH bit marks a frame that has not been shown yet,
+// so neither side waits for the other and frames the display could not
+// keep up with are overwritten. render() is fixed code: it is left a
+// surface that wraps pixels and no window, so its memcpy copies pixels onto
+// itself, which like zero-copy presentation needs glibc, and its window
+// update fails at once. The present thread is
+// stopped from an event watch on SDL_QUIT, before main() calls SDL_Quit().
+
+#define PRESENT_FRESH 4
+
+static color_u8* presentBuffers[3];
+static Uint64 presentPublishTime[3];
+static SDL_Window* presentWindow;
+static SDL_Surface* presentSurface;  // the window surface
+static SDL_Surface* presentAlias;    // what render() copies into
+static SDL_Thread* presentThread;
+static SDL_sem* presentWake;
+static SDL_atomic_t presentReady;
+static SDL_atomic_t presentPublished;
+static SDL_atomic_t presentStop;
+static int presentBack;     // slot pixels points at
+#if PRESENT_THREAD
+static int presentPending;  // a validation frame waits for errorCheck
+#endif
+
+static int SDLCALL presentLoop(void* data) {
+    (void)data;
+    int front = 2;  // the slot that is neither pixels nor ready
+    double toMs = 1000.0 / SDL_GetPerformanceFrequency();
+    double latency = 0.0, update = 0.0;
+    int shown = 0, lastPublished = 0;
+
+    for (;;) {
+        SDL_SemWait(presentWake);
+        if (SDL_AtomicGet(&presentStop)) break;
+        if (!(SDL_AtomicGet(&presentReady) & PRESENT_FRESH)) continue;
+        front = SDL_AtomicSet(&presentReady, front) & 3;
+        SDL_MemoryBarrierAcquire();
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (SDL_MUSTLOCK(presentSurface)) SDL_LockSurface(presentSurface);
+        SDL_ConvertPixels(WINDOW_WIDTH, WINDOW_HEIGHT, SDL_PIXELFORMAT_RGB888, presentBuffers[front],
+                          WINDOW_WIDTH * (int)sizeof(color_u8), presentSurface->format->format,
+                          presentSurface->pixels, presentSurface->pitch);
+        if (SDL_MUSTLOCK(presentSurface)) SDL_UnlockSurface(presentSurface);
+        SDL_UpdateWindowSurface(presentWindow);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        latency += (end - presentPublishTime[front]) * toMs;
+        update += (end - start) * toMs;
+        if (++shown % PRESENT_REPORT_INTERVAL == 0) {
+            int published = SDL_AtomicGet(&presentPublished);
+            printf("Present latency %.1f ms (copy and window update %.1f ms), %d of %d frames shown\n",
+                   latency / PRESENT_REPORT_INTERVAL, update / PRESENT_REPORT_INTERVAL,
+                   PRESENT_REPORT_INTERVAL, published - lastPublished);
+            latency = update = 0.0;
+            lastPublished = published;
+        }
+    }
+    return 0;
+}
+
+static void stopPresentThread(void) {
+    if (!presentThread) return;
+    SDL_AtomicSet(&presentStop, 1);
+    SDL_SemPost(presentWake);
+    SDL_WaitThread(presentThread, NULL);
+    presentThread = NULL;
+}
+
+static int SDLCALL presentQuitWatch(void* data, SDL_Event* event) {
+    (void)data;
+    if (event->type == SDL_QUIT) stopPresentThread();
+    return 0;
+}
+
+void startPresentThread(void) {
+    presentBuffers[0] = pixels;
+    presentBuffers[1] = (color_u8*)malloc(sizeof(color_u8) * SIZE);
+    presentBuffers[2] = (color_u8*)malloc(sizeof(color_u8) * SIZE);
+    presentAlias = SDL_CreateRGBSurfaceWithFormatFrom(pixels, WINDOW_WIDTH, WINDOW_HEIGHT, 32,
+                                                      WINDOW_WIDTH * (int)sizeof(color_u8), SDL_PIXELFORMAT_RGB888);
+    presentWake = SDL_CreateSemaphore(0);
+    presentWindow = win;
+    presentSurface = surf;
+    presentBack = 0;
+    SDL_AtomicSet(&presentReady, 1);
+    if (win && surf && presentBuffers[1] && presentBuffers[2] && presentAlias && presentWake) {
+        presentThread = SDL_CreateThread(presentLoop, "present", NULL);
+    }
+    if (!presentThread) {
+        printf("Present thread unavailable (%s), presenting from render()\n", SDL_GetError());
+        return;
+    }
+    SDL_AddEventWatch(presentQuitWatch, NULL);
+    surf = presentAlias;
+    win = NULL;
+    printf("Present thread: frames are shown from a triple buffer on their own thread\n");
+}
+
+#if PRESENT_THREAD
+// Hands the finished frame in pixels to the present thread and moves
+// pixels on to the buffer that comes back
+static void publishFrame(void) {
+    presentPending = 0;
+    if (!presentThread) return;
+    presentPublishTime[presentBack] = SDL_GetPerformanceCounter();
+    SDL_MemoryBarrierRelease();
+    presentBack = SDL_AtomicSet(&presentReady, presentBack | PRESENT_FRESH) & 3;
+    SDL_AtomicAdd(&presentPublished, 1);
+    SDL_SemPost(presentWake);
+    pixels = presentBuffers[presentBack];
+    presentAlias->pixels = pixels;
+}
+
+// Leaves fixedDestroy the buffer fixedInit allocated
+static void destroyPresentThread(void) {
+    stopPresentThread();
+    if (!presentBuffers[0]) return;
+    pixels = presentBuffers[0];
+    free(presentBuffers[1]);
+    free(presentBuffers[2]);
+    if (presentAlias) SDL_FreeSurface(presentAlias);
+    if (presentWake) SDL_DestroySemaphore(presentWake);
+    presentBuffers[0] = NULL;
+}
+#endif
+
+
+
+////////////////////////////////////////////////
+//           ¤¤ CAMERA ZOOM AND PAN ¤¤        //
+////////////////////////////////////////////////
+// Pixel (x, y) shows the world point (cameraX + x * cameraStep, cameraY +
+// y * cameraStep). The wheel zooms about the cursor, + and - about the
+// window centre. Input arrives through an event watch, which SDL calls on
+// the main thread while main() polls, so the view never changes mid-frame.
+// The cursor, and with it the black hole, is mapped into world space too;
+// physics keeps it on whole world units.
+//
+// The host culls the satellites against the view's world-space box before
+// every launch. Those within the smallest farthest-point distance of any
+// satellite (the treecode's reach) can be nearest to some pixel, and so can
+// any satellite whose weight varies too much over a CAMERA_CELL cell for
+// bilinear interpolation: all of these go to shade, which sums them exactly
+// and takes the hit test and nearest satellite from them. The rest are
+// summed on the host at the cell corners and shade interpolates the sums.
+// Interpolation over a cell of side h is off by at most h^2 / 4 times the
+// largest second derivative, which is below 20 / r^6 for r^-4, and each
+// satellite may use the treecode's share tau * W / SATELLITE_COUNT with
+// W >= 1 / reach^4. The bound falls with the square of the zoom, so a
+// zoomed-in view leaves shade a handful of satellites per pixel.
+
+#if CAMERA_VIEW
+static float cameraX = 0.f, cameraY = 0.f, cameraStep = 1.f;
+
+// Satellites near the view (positions, identifiers) and the corner sums
+static cl_mem    d_view_sats[5] = { NULL };
+static cl_mem    d_view_grid    = NULL;
+static float     h_view_sats[5][SATELLITE_COUNT];
+static cl_float4 h_view_grid[CAMERA_CORNERS];
+static int       viewSmooth[SATELLITE_COUNT];
+
+// Zooms by factor, keeping the world point under pixel (sx, sy) in place
+static void zoomCamera(float factor, float sx, float sy) {
+    float step = cameraStep / factor;
+    step = step < 1.0f / CAMERA_MAX_ZOOM ? 1.0f / CAMERA_MAX_ZOOM : step;
+    step = step > 1.0f / CAMERA_MIN_ZOOM ? 1.0f / CAMERA_MIN_ZOOM : step;
+    cameraX += sx * (cameraStep - step);
+    cameraY += sy * (cameraStep - step);
+    cameraStep = step;
+}
+
+static int SDLCALL cameraEventWatch(void* data, SDL_Event* event) {
+    const float centreX = WINDOW_WIDTH / 2.0f, centreY = WINDOW_HEIGHT / 2.0f;
+    (void)data;
+    if (frameNumber < 2) return 0;  // the validation frames use the window view
+
+    if (event->type == SDL_MOUSEWHEEL) {
+        int x, y;
+        int clicks = event->wheel.direction == SDL_MOUSEWHEEL_FLIPPED ? -event->wheel.y : event->wheel.y;
+        SDL_GetMouseState(&x, &y);
+        zoomCamera(powf(CAMERA_ZOOM_STEP, (float)clicks), (float)x, (float)y);
+    } else if (event->type == SDL_KEYDOWN) {
+        switch (event->key.keysym.sym) {
+        case SDLK_LEFT:  cameraX -= CAMERA_PAN * cameraStep; break;
+        case SDLK_RIGHT: cameraX += CAMERA_PAN * cameraStep; break;
+        case SDLK_UP:    cameraY -= CAMERA_PAN * cameraStep; break;
+        case SDLK_DOWN:  cameraY += CAMERA_PAN * cameraStep; break;
+        case SDLK_PLUS: case SDLK_EQUALS: case SDLK_KP_PLUS:
+            zoomCamera(CAMERA_ZOOM_STEP, centreX, centreY);
+            break;
+        case SDLK_MINUS: case SDLK_KP_MINUS:
+            zoomCamera(1.0f / CAMERA_ZOOM_STEP, centreX, centreY);
+            break;
+        case SDLK_0: case SDLK_KP_0: case SDLK_HOME:
+            cameraX = cameraY = 0.f;
+            cameraStep = 1.f;
+            break;
+        default:
+            return 0;
+        }
+    } else {
+        return 0;
+    }
+    printf("Camera: zoom %.2f, world (%.1f, %.1f) to (%.1f, %.1f)\n", 1.0f / cameraStep, cameraX, cameraY,
+           cameraX + WINDOW_WIDTH * cameraStep, cameraY + WINDOW_HEIGHT * cameraStep);
+    return 0;
+}
+
+void startCameraControls(void) {
+    SDL_AddEventWatch(cameraEventWatch, NULL);
+}
+
+// Takes the cursor position compute() read into world space
+void cursorToWorld(void) {
+    mousePosX = (int)floorf(cameraX + mousePosX * cameraStep + 0.5f);
+    mousePosY = (int)floorf(cameraY + mousePosY * cameraStep + 0.5f);
+}
+
+// Squared distance from a point to the nearest / farthest point of a box
+static float pointBoxDistance2(float px, float py, float x0, float y0, float x1, float y1) {
+    float dx = fmaxf(fmaxf(x0 - px, px - x1), 0.f);
+    float dy = fmaxf(fmaxf(y0 - py, py - y1), 0.f);
+    return dx * dx + dy * dy;
+}
+
+static float pointBoxFarthest2(float px, float py, float x0, float y0, float x1, float y1) {
+    float dx = fmaxf(px - x0, x1 - px);
+    float dy = fmaxf(py - y0, y1 - py);
+    return dx * dx + dy * dy;
+}
+
+// Culls the satellites against the view, sums the far ones at the cell
+// corners and launches shade with both
+static void shadeCameraView(void) {
+    cl_int err;
+    if (!d_view_grid) {
+        for (int k = 0; k < 5; ++k) {
+            d_view_sats[k] = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, SATELLITE_COUNT * sizeof(float), NULL, &err); CL_CHECK(err);
+        }
+        d_view_grid = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, sizeof(h_view_grid), NULL, &err); CL_CHECK(err);
+    }
+
+    // Largest spread of identifier values within one colour channel
+    float lo[3] = { INFINITY, INFINITY, INFINITY }, hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for (int j = 0; j < SATELLITE_COUNT; ++j) {
+        lo[0] = fminf(lo[0], satellites[j].identifier.red); hi[0] = fmaxf(hi[0], satellites[j].identifier.red);
+        lo[1] = fminf(lo[1], satellites[j].identifier.green); hi[1] = fmaxf(hi[1], satellites[j].identifier.green);
+        lo[2] = fminf(lo[2], satellites[j].identifier.blue); hi[2] = fmaxf(hi[2], satellites[j].identifier.blue);
+    }
+    float idRange = fmaxf(hi[0] - lo[0], fmaxf(hi[1] - lo[1], hi[2] - lo[2]));
+    float tau = CAMERA_ERROR_BUDGET / (3.0f * 255.0f * idRange + CAMERA_ERROR_BUDGET);
+
+    // The box spans every cell corner, also those past the window edge
+    const float h = CAMERA_CELL * cameraStep;
+    const float vx1 = cameraX + CAMERA_CELLS_X * h, vy1 = cameraY + CAMERA_CELLS_Y * h;
+    float reach2 = INFINITY;
+    for (int j = 0; j < SATELLITE_COUNT; ++j) {
+        reach2 = fminf(reach2, pointBoxFarthest2(satellites[j].position.x, satellites[j].position.y,
+                                                 cameraX, cameraY, vx1, vy1));
+    }
+    const float allowed = tau / (reach2 * reach2) / SATELLITE_COUNT;
+    const float curvature = 5.0f * h * h;
+
+    int nearCount = 0, smoothCount = 0;
+    for (int j = 0; j < SATELLITE_COUNT; ++j) {
+        float sx = satellites[j].position.x, sy = satellites[j].position.y;
+        float d2 = pointBoxDistance2(sx, sy, cameraX, cameraY, vx1, vy1);
+        if (d2 > reach2 && curvature <= allowed * d2 * d2 * d2) {
+            viewSmooth[smoothCount++] = j;
+            continue;
+        }
+        h_view_sats[0][nearCount] = sx;
+        h_view_sats[1][nearCount] = sy;
+        h_view_sats[2][nearCount] = satellites[j].identifier.red;
+        h_view_sats[3][nearCount] = satellites[j].identifier.green;
+        h_view_sats[4][nearCount] = satellites[j].identifier.blue;
+        ++nearCount;
+    }
+
+    int g;
+#pragma omp parallel for schedule(static)
+    for (g = 0; g < CAMERA_CORNERS; ++g) {
+        float gx = cameraX + (g % (CAMERA_CELLS_X + 1)) * h;
+        float gy = cameraY + (g / (CAMERA_CELLS_X + 1)) * h;
+        float w0 = 0.f, r0 = 0.f, g0 = 0.f, b0 = 0.f;
+        for (int k = 0; k < smoothCount; ++k) {
+            const satellite* s = &satellites[viewSmooth[k]];
+            float dx = gx - s->position.x, dy = gy - s->position.y;
+            float d2 = dx * dx + dy * dy;
+            float w = 1.0f / (d2 * d2);
+            w0 += w;
+            r0 += s->identifier.red * w;
+            g0 += s->identifier.green * w;
+            b0 += s->identifier.blue * w;
+        }
+        h_view_grid[g].s[0] = w0;
+        h_view_grid[g].s[1] = r0;
+        h_view_grid[g].s[2] = g0;
+        h_view_grid[g].s[3] = b0;
+    }
+
+    for (int k = 0; k < 5; ++k) {
+        CL_CHECK(clEnqueueWriteBuffer(clQ, d_view_sats[k], CL_FALSE, 0, sizeof(float) * nearCount, h_view_sats[k], 0, NULL, NULL));
+    }
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_view_grid, CL_FALSE, 0, sizeof(h_view_grid), h_view_grid, 0, NULL, NULL));
+
+    float bh_r2 = BLACK_HOLE_RADIUS * BLACK_HOLE_RADIUS;
+    float sat_r2 = SATELLITE_RADIUS * SATELLITE_RADIUS;
+    int   mx = mousePosX;
+    int   my = mousePosY;
+    int   width = WINDOW_WIDTH;
+    int   height = WINDOW_HEIGHT;
+    int   cell = CAMERA_CELL;
+    int arg = 0;
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_pixels));
+    for (int k = 0; k < 5; ++k) CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_view_sats[k]));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(nearCount), &nearCount));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(width), &width));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(height), &height));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(bh_r2), &bh_r2));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(sat_r2), &sat_r2));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(mx), &mx));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(my), &my));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cameraX), &cameraX));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cameraY), &cameraY));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cameraStep), &cameraStep));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_view_grid));
+    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cell), &cell));
+
+    size_t local[2] = { WGX, WGY };
+    size_t global[2] = { ((size_t)WINDOW_WIDTH + WGX - 1) / WGX * WGX,
+                         ((size_t)WINDOW_HEIGHT + WGY - 1) / WGY * WGY };
+    CL_CHECK(clEnqueueNDRangeKernel(clQ, clKer, 2, NULL, global, local, 0, NULL, NULL));
+}
+#endif
+
+
+// Uploads the satellites for shade_constant as float4 pairs (x, y, 0, 0),
+// (red, green, blue, 0) in device slot order
+static void packSatellites(const float* h_pos_x, const float* h_pos_y) {
+    static cl_float4 packed[2 * SATELLITE_COUNT];
+    for (int k = 0; k < SATELLITE_COUNT; ++k) {
+        int j = k;
+#if SORT_SATELLITES
+        j = satOrder[k];
+#endif
+        packed[2 * k].s[0] = h_pos_x[k];
+        packed[2 * k].s[1] = h_pos_y[k];
+        packed[2 * k].s[2] = packed[2 * k].s[3] = 0.f;
+        packed[2 * k + 1].s[0] = satellites[j].identifier.red;
+        packed[2 * k + 1].s[1] = satellites[j].identifier.green;
+        packed[2 * k + 1].s[2] = satellites[j].identifier.blue;
+        packed[2 * k + 1].s[3] = 0.f;
+    }
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_sat_packed, CL_FALSE, 0, sizeof(packed), packed, 0, NULL, NULL));
+}
+
+// Shades the current frame and reads it back into pixels
+static void shadeFrame(void) {
+#if ZERO_COPY_PRESENT
+    if (frameNumber == 2 && correctPixels) releaseValidationBuffer();
+#endif
+#if CAMERA_VIEW
+    // Validation frames are shaded in the window view
+    if (frameNumber >= 2) {
+        shadeCameraView();
+        CL_CHECK(clEnqueueReadBuffer(clQ, d_pixels, CL_TRUE, 0,
+            sizeof(unsigned char) * 4 * SIZE, pixels, 0, NULL, NULL));
+        return;
+    }
+#endif
 
     // prepare host SoA arrays each frame
     float h_pos_x[SATELLITE_COUNT];
     float h_pos_y[SATELLITE_COUNT];
 
+#if SORT_SATELLITES
+    float h_id_r[SATELLITE_COUNT], h_id_g[SATELLITE_COUNT], h_id_b[SATELLITE_COUNT];
+    if (shadeKernel == KERNEL_EXACT) {
+        for (int j = 0; j < SATELLITE_COUNT; ++j) satOrder[j] = j; // the reference's order
+    } else {
+        sortSatellitesSpatially();
+    }
+    for (int k = 0; k < SATELLITE_COUNT; ++k) {
+        int j = satOrder[k];
+        h_pos_x[k] = satellites[j].position.x;
+        h_pos_y[k] = satellites[j].position.y;
+        h_id_r[k] = satellites[j].identifier.red;
+        h_id_g[k] = satellites[j].identifier.green;
+        h_id_b[k] = satellites[j].identifier.blue;
+    }
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_id_r, CL_FALSE, 0, sizeof(h_id_r), h_id_r, 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_id_g, CL_FALSE, 0, sizeof(h_id_g), h_id_g, 0, NULL, NULL));
+    CL_CHECK(clEnqueueWriteBuffer(clQ, d_id_b, CL_FALSE, 0, sizeof(h_id_b), h_id_b, 0, NULL, NULL));
+#else
     for (int j = 0; j < SATELLITE_COUNT; ++j) {
         h_pos_x[j] = satellites[j].position.x;
         h_pos_y[j] = satellites[j].position.y;
     }
+#endif
 
     // write satellites to device
     CL_CHECK(clEnqueueWriteBuffer(clQ, d_pos_x, CL_FALSE, 0, sizeof(h_pos_x), h_pos_x, 0, NULL, NULL));
@@ -470,48 +1770,544 @@ void parallelGraphicsEngine(void) {
     int   height = WINDOW_HEIGHT;
 
     // set kernel args
+    cl_kernel ker = shadeKernel == KERNEL_TABLE ? clKerTable :
+                    shadeKernel == KERNEL_VORONOI ? clKerNearestShade :
+                    shadeKernel == KERNEL_GRID ? clKerGrid :
+                    shadeKernel == KERNEL_STAMP ? clKerWeights :
+                    shadeKernel == KERNEL_EXACT ? clKerExact :
+                    shadeKernel == KERNEL_LOCAL ? clKerLocal :
+                    shadeKernel == KERNEL_CONSTANT ? clKerConstant :
+                    shadeKernel == KERNEL_BLOCKED ? clKerBlocked : clKer;
     int arg = 0;
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_pixels));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_pos_x));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_pos_y));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_id_r));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_id_g));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(cl_mem), &d_id_b));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(satCount), &satCount));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(width), &width));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(height), &height));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(bh_r2), &bh_r2));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(sat_r2), &sat_r2));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(mx), &mx));
-    CL_CHECK(clSetKernelArg(clKer, arg++, sizeof(my), &my));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_pixels));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_pos_x));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_pos_y));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_id_r));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_id_g));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_id_b));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(satCount), &satCount));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(width), &width));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(height), &height));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(bh_r2), &bh_r2));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(sat_r2), &sat_r2));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(mx), &mx));
+    CL_CHECK(clSetKernelArg(ker, arg++, sizeof(my), &my));
+    if (ker == clKer) {
+        // the window view without a far field
+        float viewX = 0.f, viewY = 0.f, viewStep = 1.f;
+        cl_mem noGrid = NULL;
+        int noCell = 0;
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(viewX), &viewX));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(viewY), &viewY));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(viewStep), &viewStep));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &noGrid));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(noCell), &noCell));
+    } else if (ker == clKerTable) {
+        // local tables: dx^2 per column, dy^2 per row, identifiers
+        int chunk = TABLE_CHUNK;
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(float) * TABLE_CHUNK * WGX, NULL));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(float) * TABLE_CHUNK * WGY, NULL));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_float4) * TABLE_CHUNK, NULL));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(chunk), &chunk));
+    } else if (ker == clKerLocal) {
+        int chunk = LOCAL_CHUNK;
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_float4) * 2 * LOCAL_CHUNK, NULL));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(chunk), &chunk));
+    } else if (ker == clKerConstant) {
+        packSatellites(h_pos_x, h_pos_y);
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_sat_packed));
+    } else if (ker == clKerExact) {
+        float bhRadius = BLACK_HOLE_RADIUS, satRadius = SATELLITE_RADIUS;
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(bhRadius), &bhRadius));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(satRadius), &satRadius));
+    }
+
+#if PROGRESSIVE_RENDERING
+    // Validation frames are always rendered in full
+    if (frameNumber >= 2) {
+        arg = 0;
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_pixels));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_pos_x));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_pos_y));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_id_r));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_id_g));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(cl_mem), &d_id_b));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(satCount), &satCount));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(width), &width));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(height), &height));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(bh_r2), &bh_r2));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(sat_r2), &sat_r2));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(mx), &mx));
+        CL_CHECK(clSetKernelArg(clKerProg, arg++, sizeof(my), &my));
+        progressiveShade(h_pos_x, h_pos_y, mx, my);
+
+        CL_CHECK(clEnqueueReadBuffer(clQ, d_pixels, CL_TRUE, 0,
+            sizeof(unsigned char) * 4 * SIZE, pixels, 0, NULL, NULL));
+        return;
+    }
+#endif
 
     // global dims rounded up to multiples of WG
     size_t local[2] = { WGX, WGY };
     size_t g0 = ((size_t)WINDOW_WIDTH + WGX - 1) / WGX * WGX;
     size_t g1 = ((size_t)WINDOW_HEIGHT + WGY - 1) / WGY * WGY;
     size_t global[2] = { g0, g1 };
+    if (ker == clKerBlocked) {
+        // one work-item per block of pixels
+        global[0] = ((size_t)(WINDOW_WIDTH + blockX - 1) / blockX + WGX - 1) / WGX * WGX;
+        global[1] = ((size_t)(WINDOW_HEIGHT + blockY - 1) / blockY + WGY - 1) / WGY * WGY;
+    }
+
+    if (ker == clKerNearestShade) {
+        nearestMapPass(h_pos_x, h_pos_y, g0, g1);
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_nearest));
+    } else if (ker == clKerGrid) {
+        int cellsX = GRID_CELLS_X, cellsY = GRID_CELLS_Y, cellSize = GRID_CELL;
+        uploadGridLists(h_pos_x, h_pos_y, (int)(g0 / WGX), (int)(g1 / WGY));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_cell_start));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_cell_list));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cellsX), &cellsX));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cellsY), &cellsY));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cellSize), &cellSize));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_tile_start));
+        CL_CHECK(clSetKernelArg(ker, arg++, sizeof(cl_mem), &d_tile_cand));
+    }
 
     // launch
-    CL_CHECK(clEnqueueNDRangeKernel(clQ, clKer, 2, NULL, global, local, 0, NULL, NULL));
+    CL_CHECK(clEnqueueNDRangeKernel(clQ, ker, 2, NULL, global, local, 0, NULL, NULL));
+    if (ker == clKerWeights) stampDiscs(bh_r2, sat_r2, mx, my);
     CL_CHECK(clFinish(clQ));
 
     CL_CHECK(clEnqueueReadBuffer(clQ, d_pixels, CL_TRUE, 0,
         sizeof(unsigned char) * 4 * SIZE, pixels, 0, NULL, NULL));
+    if (ker == clKerExact && frameNumber < 2) checkExactFrame();
+}
+
+void parallelGraphicsEngine(void) {
+#if PRESENT_THREAD
+    if (presentPending) publishFrame();
+#endif
+    shadeFrame();
+#if PRESENT_THREAD
+    // compute() checks validation frames in pixels after this returns
+    if (frameNumber >= 2) publishFrame();
+    else presentPending = 1;
+#endif
+}
+
+
+
+
+// Times shadeKernel (including upload and read-back) on the current frame
+// and prints it with its largest difference from reference, which it fills
+// instead when fill is set
+static void benchmarkShadeKernel(const char* name, color_u8* reference, int fill) {
+    const int runs = 10;
+    parallelGraphicsEngine(); // warm-up
+    frameNumber = 2;          // time without the validation-frame checks
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int r = 0; r < runs; ++r) parallelGraphicsEngine();
+    double ms = (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency() / runs;
+    frameNumber = 0;
+
+    if (fill) memcpy(reference, pixels, sizeof(color_u8) * SIZE);
+    int maxDiff = 0;
+    for (int i = 0; i < SIZE; ++i) {
+        int d = abs(reference[i].red - pixels[i].red);
+        int dg = abs(reference[i].green - pixels[i].green);
+        int db = abs(reference[i].blue - pixels[i].blue);
+        d = dg > d ? dg : d;
+        d = db > d ? db : d;
+        maxDiff = d > maxDiff ? d : maxDiff;
+    }
+    printf("  %-8s %9.2f ms   max diff %3d\n", name, ms, maxDiff);
+}
+
+// Times every shading kernel on the current frame and compares it against
+// shade, then the blocked kernel built with each blocking factor
+void benchmarkKernels(void) {
+    static const struct { const char* name; int kernel; } kernels[] = {
+        { "shade", KERNEL_SHADE },
+        { "table", KERNEL_TABLE },
+        { "local", KERNEL_LOCAL },
+        { "constant", KERNEL_CONSTANT },
+        { "voronoi", KERNEL_VORONOI },
+        { "grid",    KERNEL_GRID },
+        { "stamp",   KERNEL_STAMP },
+        { "exact",   KERNEL_EXACT },
+    };
+    static const int blocks[][2] = { { 4, 1 }, { 8, 1 }, { 2, 2 } };
+    mousePosX = WINDOW_WIDTH / 2;
+    mousePosY = WINDOW_HEIGHT / 2;
+
+    color_u8* reference = (color_u8*)malloc(sizeof(color_u8) * SIZE);
+    printf("Kernel benchmark with %d satellites, %zux%zu work-groups:\n", SATELLITE_COUNT, WGX, WGY);
+    for (unsigned k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k) {
+        if (kernels[k].kernel == KERNEL_CONSTANT && !constantFits) {
+            printf("  %-8s skipped, satellites do not fit constant memory\n", kernels[k].name);
+            continue;
+        }
+        shadeKernel = kernels[k].kernel;
+        benchmarkShadeKernel(kernels[k].name, reference, k == 0);
+    }
+
+    size_t srcLen = 0;
+    char* src = loadTextFile("parallel.cl", &srcLen);
+    cl_kernel configured = clKerBlocked;
+    shadeKernel = KERNEL_BLOCKED;
+    for (unsigned b = 0; b < sizeof(blocks) / sizeof(blocks[0]); ++b) {
+        cl_int err;
+        char options[256], name[16];
+        blockX = blocks[b][0];
+        blockY = blocks[b][1];
+        snprintf(options, sizeof(options), "%s -DBLOCK_X=%d -DBLOCK_Y=%d", FAST_BUILD_OPTIONS, blockX, blockY);
+        snprintf(name, sizeof(name), "blk %dx%d", blockX, blockY);
+        cl_program prog = buildProgram(src, srcLen, options);
+        clKerBlocked = clCreateKernel(prog, "shade_blocked", &err); CL_CHECK(err);
+        benchmarkShadeKernel(name, reference, 0);
+        clReleaseKernel(clKerBlocked);
+        clReleaseProgram(prog);
+    }
+    clKerBlocked = configured;
+    blockX = SHADE_BLOCK_X;
+    blockY = SHADE_BLOCK_Y;
+    free(src);
+
+    shadeKernel = SHADE_KERNEL;
+    free(reference);
+}
+
+
+////////////////////////////////////////////////
+//           ¤¤ HEADLESS FRAME LOOP ¤¤        //
+////////////////////////////////////////////////
+// main() always opens the window before init() runs; without a display that
+// call fails and the window is simply never used. At the window size every
+// frame goes through compute(), so kernels, validation frames and printed
+// timings are those of a windowed run without render(). Any other size is
+// shaded by shade_scaled, the shade kernel's per-pixel path with the pixel
+// centres mapped to window coordinates, into a device frame of that size
+// and read back into an owned, 64-byte aligned host frame. The other
+// kernels build their tables and grids for the window and only run there.
+
+// Reads a positive integer from the environment, or returns fallback
+static int headlessSetting(const char* name, int fallback) {
+    const char* value = getenv(name);
+    int n = value ? atoi(value) : 0;
+    return n > 0 ? n : fallback;
+}
+
+// Points shade_scaled at a frame of width x height and the given positions
+static void setScaledKernelArgs(cl_mem frame, cl_mem posX, cl_mem posY, int width, int height, int mx, int my) {
+    float bh_r2 = BLACK_HOLE_RADIUS * BLACK_HOLE_RADIUS;
+    float sat_r2 = SATELLITE_RADIUS * SATELLITE_RADIUS;
+    float scaleX = (float)WINDOW_WIDTH / width, scaleY = (float)WINDOW_HEIGHT / height;
+    int satCount = SATELLITE_COUNT;
+    int arg = 0;
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &frame));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &posX));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &posY));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &d_id_r));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &d_id_g));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(cl_mem), &d_id_b));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(satCount), &satCount));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(width), &width));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(height), &height));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(bh_r2), &bh_r2));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(sat_r2), &sat_r2));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(mx), &mx));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(my), &my));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(scaleX), &scaleX));
+    CL_CHECK(clSetKernelArg(clKerScaled, arg++, sizeof(scaleY), &scaleY));
 }
 
+void headlessRun(void) {
+    int width = headlessSetting("HEADLESS_WIDTH", WINDOW_WIDTH);
+    int height = headlessSetting("HEADLESS_HEIGHT", WINDOW_HEIGHT);
+    int frames = headlessSetting("HEADLESS_FRAMES", HEADLESS_DEFAULT_FRAMES);
+    if (width < HEADLESS_MIN_WIDTH || height < HEADLESS_MIN_HEIGHT ||
+        width > HEADLESS_MAX_WIDTH || height > HEADLESS_MAX_HEIGHT) {
+        fprintf(stderr, "Headless frame %dx%d is outside %dx%d to %dx%d\n", width, height,
+                HEADLESS_MIN_WIDTH, HEADLESS_MIN_HEIGHT, HEADLESS_MAX_WIDTH, HEADLESS_MAX_HEIGHT);
+        exit(1);
+    }
+    printf("Headless: %d frames at %dx%d\n", frames, width, height);
 
+    if (width == WINDOW_WIDTH && height == WINDOW_HEIGHT) {
+        for (int f = 0; f < frames; ++f) {
+            compute();
+            frameNumber++;
+        }
+        return;
+    }
+
+    if (shadeKernel != KERNEL_SHADE) {
+        fprintf(stderr, "The selected kernel only shades %dx%d frames; headless runs at other sizes "
+                "need the shade kernel\n", WINDOW_WIDTH, WINDOW_HEIGHT);
+        exit(1);
+    }
+    cl_int err;
+    size_t bytes = sizeof(color_u8) * (size_t)width * height;
+#ifdef _MSC_VER
+    color_u8* frame = (color_u8*)_aligned_malloc(bytes, 64);
+#else
+    color_u8* frame = (color_u8*)aligned_alloc(64, (bytes + 63) / 64 * 64);
+#endif
+    if (!frame) {
+        fprintf(stderr, "Could not allocate a %dx%d frame\n", width, height);
+        exit(1);
+    }
+    cl_mem d_frame = clCreateBuffer(clCtx, CL_MEM_WRITE_ONLY, bytes, NULL, &err); CL_CHECK(err);
+
+    int mx = WINDOW_WIDTH / 2, my = WINDOW_HEIGHT / 2;
+    setScaledKernelArgs(d_frame, d_pos_x, d_pos_y, width, height, mx, my);
+
+    size_t local[2] = { WGX, WGY };
+    size_t global[2] = { ((size_t)width + WGX - 1) / WGX * WGX, ((size_t)height + WGY - 1) / WGY * WGY };
+    double shadeMs = 0.0;
+    for (int f = 0; f < frames; ++f) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        mousePosX = mx;
+        mousePosY = my;
+        parallelPhysicsEngine();
+        Uint64 moved = SDL_GetPerformanceCounter();
+
+        float h_pos_x[SATELLITE_COUNT];
+        float h_pos_y[SATELLITE_COUNT];
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            h_pos_x[j] = satellites[j].position.x;
+            h_pos_y[j] = satellites[j].position.y;
+        }
+        CL_CHECK(clEnqueueWriteBuffer(clQ, d_pos_x, CL_FALSE, 0, sizeof(h_pos_x), h_pos_x, 0, NULL, NULL));
+        CL_CHECK(clEnqueueWriteBuffer(clQ, d_pos_y, CL_FALSE, 0, sizeof(h_pos_y), h_pos_y, 0, NULL, NULL));
+        CL_CHECK(clEnqueueNDRangeKernel(clQ, clKerScaled, 2, NULL, global, local, 0, NULL, NULL));
+        CL_CHECK(clEnqueueReadBuffer(clQ, d_frame, CL_TRUE, 0, bytes, frame, 0, NULL, NULL));
+        Uint64 shaded = SDL_GetPerformanceCounter();
+
+        double freq = (double)SDL_GetPerformanceFrequency();
+        double ms = (shaded - moved) * 1000.0 / freq;
+        shadeMs += ms;
+        printf("Headless frame %d: %.1f + %.1f ms (%.1f Mpixels/s)\n", f,
+               (moved - start) * 1000.0 / freq, ms, (double)width * height / ms / 1000.0);
+        frameNumber++;
+    }
+    printf("Averaged shading time: %.1f ms\n", shadeMs / frames);
+
+    clReleaseMemObject(d_frame);
+#ifdef _MSC_VER
+    _aligned_free(frame);
+#else
+    free(frame);
+#endif
+}
+
+
+////////////////////////////////////////////////
+//          ¤¤ OFFLINE MOVIE RENDER ¤¤        //
+////////////////////////////////////////////////
+// Every one of MOVIE_QUEUE slots owns device positions, a device frame and
+// a host image. The main thread moves the satellites and queues upload and
+// shade_scaled for frame f in slot f % MOVIE_QUEUE on clQ, and a
+// non-blocking read of that frame on a second queue that waits for the
+// launch's event, then goes on with the physics of the next frame while the
+// device works. Launches still run one after another on clQ; the second
+// queue lets the read of frame f overlap the upload and launch of frame
+// f + 1 on devices with a separate copy engine. A
+// writer thread waits for each read in frame order and writes the image to
+// the sink; slots go back to the main thread once written. Frame f shows the
+// satellites after f + 1 frames. MOVIE_FILE may be a named pipe read by an
+// encoder, such as ffmpeg -f image2pipe -c:v ppm -i <pipe>.
+
+typedef struct{
+   FILE* file;
+   int width, height, frames;
+   float posX[MOVIE_QUEUE][SATELLITE_COUNT];   // upload sources, kept until the read ends
+   float posY[MOVIE_QUEUE][SATELLITE_COUNT];
+   cl_mem d_pos_x[MOVIE_QUEUE], d_pos_y[MOVIE_QUEUE], d_frame[MOVIE_QUEUE];
+   color_u8* images[MOVIE_QUEUE];
+   cl_event readDone[MOVIE_QUEUE];
+   cl_command_queue readQ;   // frame reads, each behind its launch's event
+   SDL_sem* filled;       // frames queued, waiting for the writer
+   SDL_sem* free;         // slots the main thread may reuse
+   unsigned char* row;    // one image row in RGB, owned by the writer
+   Uint64 writeTicks;
+   int failed;
+} movieState;
+
+// Writer thread: frame f goes out as one PPM image once its read has ended
+static int movieWriter(void* data) {
+    movieState* ms = (movieState*)data;
+    const size_t rowBytes = 3 * (size_t)ms->width;
+    for (int f = 0; f < ms->frames; ++f) {
+        int slot = f % MOVIE_QUEUE;
+        SDL_SemWait(ms->filled);
+        CL_CHECK(clWaitForEvents(1, &ms->readDone[slot]));
+        clReleaseEvent(ms->readDone[slot]);
+        Uint64 start = SDL_GetPerformanceCounter();
+        const color_u8* image = ms->images[slot];
+        if (!ms->failed) ms->failed = fprintf(ms->file, "P6\n%d %d\n255\n", ms->width, ms->height) < 0;
+        for (int y = 0; y < ms->height && !ms->failed; ++y) {
+            const color_u8* src = image + (size_t)y * ms->width;
+            for (int x = 0; x < ms->width; ++x) {
+                ms->row[3 * x] = src[x].red;
+                ms->row[3 * x + 1] = src[x].green;
+                ms->row[3 * x + 2] = src[x].blue;
+            }
+            ms->failed = fwrite(ms->row, 1, rowBytes, ms->file) != rowBytes;
+        }
+        ms->writeTicks += SDL_GetPerformanceCounter() - start;
+        SDL_SemPost(ms->free);
+    }
+    return 0;
+}
+
+void movieRun(void) {
+    cl_int err;
+    movieState* ms = (movieState*)calloc(1, sizeof(movieState));
+    ms->width = headlessSetting("MOVIE_WIDTH", WINDOW_WIDTH);
+    ms->height = headlessSetting("MOVIE_HEIGHT", WINDOW_HEIGHT);
+    ms->frames = headlessSetting("MOVIE_FRAMES", MOVIE_DEFAULT_FRAMES);
+    const char* path = getenv("MOVIE_FILE") ? getenv("MOVIE_FILE") : "movie.ppm";
+    ms->file = fopen(path, "wb");
+    if (!ms->file) {
+        fprintf(stderr, "Could not write %s\n", path);
+        exit(1);
+    }
+    size_t bytes = sizeof(color_u8) * (size_t)ms->width * ms->height;
+    for (int s = 0; s < MOVIE_QUEUE; ++s) {
+        ms->d_pos_x[s] = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, SATELLITE_COUNT * sizeof(float), NULL, &err); CL_CHECK(err);
+        ms->d_pos_y[s] = clCreateBuffer(clCtx, CL_MEM_READ_ONLY, SATELLITE_COUNT * sizeof(float), NULL, &err); CL_CHECK(err);
+        ms->d_frame[s] = clCreateBuffer(clCtx, CL_MEM_WRITE_ONLY, bytes, NULL, &err); CL_CHECK(err);
+        ms->images[s] = (color_u8*)malloc(bytes);
+    }
+    ms->row = (unsigned char*)malloc(3 * (size_t)ms->width);
+    int allocated = ms->row != NULL;
+    for (int s = 0; s < MOVIE_QUEUE; ++s) allocated &= ms->images[s] != NULL;
+    if (!allocated) {
+        fprintf(stderr, "Could not allocate %d movie frames of %dx%d\n", MOVIE_QUEUE, ms->width, ms->height);
+        exit(1);
+    }
+#if defined(CL_VERSION_2_0)
+    const cl_queue_properties props[] = { CL_QUEUE_PROPERTIES, 0, 0 };
+    ms->readQ = clCreateCommandQueueWithProperties(clCtx, clDev, props, &err); CL_CHECK(err);
+#else
+    ms->readQ = clCreateCommandQueue(clCtx, clDev, 0, &err); CL_CHECK(err);
+#endif
+    ms->filled = SDL_CreateSemaphore(0);
+    ms->free = SDL_CreateSemaphore(MOVIE_QUEUE);
+    if (!ms->filled || !ms->free) {
+        fprintf(stderr, "Could not create the movie semaphores: %s\n", SDL_GetError());
+        exit(1);
+    }
+    int mx = WINDOW_WIDTH / 2, my = WINDOW_HEIGHT / 2;
+    mousePosX = mx;
+    mousePosY = my;
+    printf("Movie: %d frames at %dx%d to %s, %d frames queued\n",
+           ms->frames, ms->width, ms->height, path, MOVIE_QUEUE);
+
+    size_t local[2] = { WGX, WGY };
+    size_t global[2] = { ((size_t)ms->width + WGX - 1) / WGX * WGX, ((size_t)ms->height + WGY - 1) / WGY * WGY };
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 physics = 0;
+    SDL_Thread* writer = SDL_CreateThread(movieWriter, "movie writer", ms);
+    if (!writer) {
+        fprintf(stderr, "Could not start the movie writer: %s\n", SDL_GetError());
+        exit(1);
+    }
+    for (int f = 0; f < ms->frames; ++f) {
+        int slot = f % MOVIE_QUEUE;
+        SDL_SemWait(ms->free);
+        Uint64 moveStart = SDL_GetPerformanceCounter();
+        parallelPhysicsEngine();
+        physics += SDL_GetPerformanceCounter() - moveStart;
+        for (int j = 0; j < SATELLITE_COUNT; ++j) {
+            ms->posX[slot][j] = satellites[j].position.x;
+            ms->posY[slot][j] = satellites[j].position.y;
+        }
+        frameNumber++;
+
+        // Arguments are captured at enqueue, so every launch keeps its slot
+        setScaledKernelArgs(ms->d_frame[slot], ms->d_pos_x[slot], ms->d_pos_y[slot], ms->width, ms->height, mx, my);
+        CL_CHECK(clEnqueueWriteBuffer(clQ, ms->d_pos_x[slot], CL_FALSE, 0, sizeof(ms->posX[slot]), ms->posX[slot], 0, NULL, NULL));
+        CL_CHECK(clEnqueueWriteBuffer(clQ, ms->d_pos_y[slot], CL_FALSE, 0, sizeof(ms->posY[slot]), ms->posY[slot], 0, NULL, NULL));
+        cl_event shaded = NULL;
+        CL_CHECK(clEnqueueNDRangeKernel(clQ, clKerScaled, 2, NULL, global, local, 0, NULL, &shaded));
+        CL_CHECK(clEnqueueReadBuffer(ms->readQ, ms->d_frame[slot], CL_FALSE, 0, bytes, ms->images[slot], 1, &shaded, &ms->readDone[slot]));
+        clReleaseEvent(shaded);
+        CL_CHECK(clFlush(clQ));
+        CL_CHECK(clFlush(ms->readQ));
+        SDL_SemPost(ms->filled);
+    }
+    SDL_WaitThread(writer, NULL);
+    int failed = ms->failed | (fclose(ms->file) != 0);
+    double freq = (double)SDL_GetPerformanceFrequency();
+    double seconds = (SDL_GetPerformanceCounter() - start) / freq;
+    double perFrame = 1000.0 / freq / ms->frames;
+
+    printf("Movie: %d frames in %.2f s, %.2f frames/s sustained; per frame %.1f ms physics, %.1f ms writing%s\n",
+           ms->frames, seconds, ms->frames / seconds, physics * perFrame, ms->writeTicks * perFrame,
+           failed ? " (write failed)" : "");
+
+    SDL_DestroySemaphore(ms->filled);
+    SDL_DestroySemaphore(ms->free);
+    clReleaseCommandQueue(ms->readQ);
+    for (int s = 0; s < MOVIE_QUEUE; ++s) {
+        clReleaseMemObject(ms->d_pos_x[s]);
+        clReleaseMemObject(ms->d_pos_y[s]);
+        clReleaseMemObject(ms->d_frame[s]);
+        free(ms->images[s]);
+    }
+    free(ms->row);
+    free(ms);
+    if (failed) exit(1);
+}
 
 
 // ## You may add your own destrcution routines here ##
 void destroy() {
+#if ZERO_COPY_PRESENT
+    detachSurfacePixels();
+#endif
+#if PRESENT_THREAD
+    destroyPresentThread();
+#endif
+    stopPhysicsThread();
     if (d_pixels) clReleaseMemObject(d_pixels);
     if (d_pos_x)  clReleaseMemObject(d_pos_x);
     if (d_pos_y)  clReleaseMemObject(d_pos_y);
     if (d_id_r)   clReleaseMemObject(d_id_r);
     if (d_id_g)   clReleaseMemObject(d_id_g);
     if (d_id_b)   clReleaseMemObject(d_id_b);
+    if (d_tile_order) clReleaseMemObject(d_tile_order);
+    if (clKerProg) clReleaseKernel(clKerProg);
     if (clKer)    clReleaseKernel(clKer);
+    if (clKerTable) clReleaseKernel(clKerTable);
+    if (clKerNearestMap) clReleaseKernel(clKerNearestMap);
+    if (clKerNearestShade) clReleaseKernel(clKerNearestShade);
+    if (clKerGrid) clReleaseKernel(clKerGrid);
+    if (clKerWeights) clReleaseKernel(clKerWeights);
+    if (clKerStamp) clReleaseKernel(clKerStamp);
+    if (clKerScaled) clReleaseKernel(clKerScaled);
+    if (clKerExact) clReleaseKernel(clKerExact);
+    if (clKerLocal) clReleaseKernel(clKerLocal);
+    if (clKerConstant) clReleaseKernel(clKerConstant);
+    if (clKerBlocked) clReleaseKernel(clKerBlocked);
+    if (d_sat_packed) clReleaseMemObject(d_sat_packed);
+    if (d_cell_start) clReleaseMemObject(d_cell_start);
+    if (d_cell_list)  clReleaseMemObject(d_cell_list);
+    if (d_nearest)    clReleaseMemObject(d_nearest);
+    if (d_tile_start) clReleaseMemObject(d_tile_start);
+    if (d_tile_cand)  clReleaseMemObject(d_tile_cand);
+#if CAMERA_VIEW
+    if (d_view_grid)  clReleaseMemObject(d_view_grid);
+    for (int k = 0; k < 5; ++k) {
+        if (d_view_sats[k]) clReleaseMemObject(d_view_sats[k]);
+    }
+#endif
+    free(h_tile_start);
+    free(h_tile_cand);
     if (clProg)   clReleaseProgram(clProg);
+    if (clProgExact) clReleaseProgram(clProgExact);
     if (clQ)      clReleaseCommandQueue(clQ);
     if (clCtx)    clReleaseContext(clCtx);
 }
@@ -1,3 +1,95 @@
+// Colour at a point in window coordinates (BGRA); far holds sums (weight,
+// red, green, blue) of satellites left out of the arrays, or zeros
+inline uchar4 shade_point(
+    const float px,
+    const float py,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    const float4 far)
+{
+    // Black hole check (no sqrt)
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    float d2BH = dxBH * dxBH + dyBH * dyBH;
+
+    if (d2BH < bh_r2) {
+        return (uchar4)(0, 0, 0, 0);   // BGRA = black
+    }
+
+    float sumR = far.y, sumG = far.z, sumB = far.w;
+    float weights = far.x;
+    float shortestD2 = INFINITY;
+    float nR = 0.0f, nG = 0.0f, nB = 0.0f;        // nearest id
+
+    // Single-pass satellite loop
+    for (int j = 0; j < sat_count; ++j) {
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = dx * dx + dy * dy;
+
+        if (d2 < sat_r2) {
+            return (uchar4)(255, 255, 255, 0); // BGRA = white
+        }
+
+        float inv = 1.0f / d2;
+        float w = inv * inv;
+        weights += w;
+
+        sumR += id_r[j] * w;
+        sumG += id_g[j] * w;
+        sumB += id_b[j] * w;
+
+        if (d2 < shortestD2) {
+            shortestD2 = d2;
+            nR = id_r[j]; nG = id_g[j]; nB = id_b[j];
+        }
+    }
+
+    float invW = 1.0f / weights;
+    float r = nR + 3.0f * (sumR * invW);
+    float g = nG + 3.0f * (sumG * invW);
+    float b = nB + 3.0f * (sumB * invW);
+
+    // Convert to BGRA 0..255
+    uchar ur = (uchar)(r * 255.0f);
+    uchar ug = (uchar)(g * 255.0f);
+    uchar ub = (uchar)(b * 255.0f);
+    return (uchar4)(ub, ug, ur, (uchar)0);
+}
+
+// Colour of one pixel (BGRA)
+inline uchar4 shade_pixel(
+    const int   x,
+    const int   y,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y)
+{
+    return shade_point((float)x, (float)y, sat_pos_x, sat_pos_y, id_r, id_g, id_b,
+                       sat_count, bh_r2, sat_r2, mouse_x, mouse_y, (float4)(0.0f));
+}
+
+// Pixel (x, y) shows the world point (view_x + x * view_step, view_y +
+// y * view_step); satellites and black hole are given in world space. With
+// far_cell > 0 the arrays hold only the satellites near the view, and the
+// sums of the others are interpolated bilinearly from far_grid, which has
+// them at every far_cell-th pixel in both directions (one corner more than
+// cells per row and column).
 __kernel void shade(
     __global uchar4*        out_pixels,      // SIZE = width*height (BGRA)
     __global const float*   sat_pos_x,       // SATELLITE_COUNT
@@ -11,69 +103,786 @@ __kernel void shade(
     const float bh_r2,                       // BLACK_HOLE_RADIUS^2
     const float sat_r2,                      // SATELLITE_RADIUS^2
     const int   mouse_x,                     // black hole center X
-    const int   mouse_y)                     // black hole center Y
+    const int   mouse_y,                     // black hole center Y
+    const float view_x,                      // world point of pixel (0, 0)
+    const float view_y,
+    const float view_step,                   // world units per pixel
+    __global const float4*  far_grid,        // (weight, red, green, blue) sums
+    const int   far_cell)                    // 0: no far field
 {
     const int   x = get_global_id(0);
     const int   y = get_global_id(1);
 
     if (x >= width || y >= height) return;
 
-    const int   idx = y * width + x;
-    const float px = (float)x;
-    const float py = (float)y;
+    float4 far = (float4)(0.0f);
+    if (far_cell > 0) {
+        const int cols = (width + far_cell - 1) / far_cell + 1;
+        const int cx = x / far_cell, cy = y / far_cell;
+        const float tx = (float)(x - cx * far_cell) / far_cell;
+        const float ty = (float)(y - cy * far_cell) / far_cell;
+        __global const float4* g = far_grid + cy * cols + cx;
+        far = mix(mix(g[0], g[1], tx), mix(g[cols], g[cols + 1], tx), ty);
+    }
 
-    // Black hole check (no sqrt)
+    out_pixels[y * width + x] = shade_point(view_x + x * view_step, view_y + y * view_step,
+                                            sat_pos_x, sat_pos_y, id_r, id_g, id_b,
+                                            sat_count, bh_r2, sat_r2, mouse_x, mouse_y, far);
+}
+
+// Same scene and per-pixel path as shade in a width x height frame of any
+// size: pixel centres are mapped to window coordinates with scale_x / scale_y
+// (headless and movie modes)
+__kernel void shade_scaled(
+    __global uchar4*        out_pixels,      // width*height (BGRA)
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    const float scale_x,                     // WINDOW_WIDTH / width
+    const float scale_y)                     // WINDOW_HEIGHT / height
+{
+    const int   x = get_global_id(0);
+    const int   y = get_global_id(1);
+
+    if (x >= width || y >= height) return;
+
+    out_pixels[(size_t)y * width + x] = shade_point((x + 0.5f) * scale_x - 0.5f, (y + 0.5f) * scale_y - 0.5f,
+                                                    sat_pos_x, sat_pos_y, id_r, id_g, id_b,
+                                                    sat_count, bh_r2, sat_r2, mouse_x, mouse_y, (float4)(0.0f));
+}
+
+// Same bytes as sequentialGraphicsEngine: sqrt distances, a first loop for
+// the total weight (1 / distance^4) and the nearest satellite that stops at
+// a hit, a second loop adding id * weight / weights * 3 per satellite, in
+// the reference's operation order. Exact only in a program built without
+// the fast-math options and with correctly rounded division and sqrt.
+__kernel void shade_exact(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,                       // unused, the radii are compared
+    const float sat_r2,                      // unused
+    const int   mouse_x,
+    const int   mouse_y,
+    const float bh_radius,                   // BLACK_HOLE_RADIUS
+    const float sat_radius)                  // SATELLITE_RADIUS
+{
+#pragma OPENCL FP_CONTRACT OFF
+    const int   x = get_global_id(0);
+    const int   y = get_global_id(1);
+
+    if (x >= width || y >= height) return;
+
+    const float px = (float)x, py = (float)y;
     float dxBH = px - (float)mouse_x;
     float dyBH = py - (float)mouse_y;
-    float d2BH = dxBH * dxBH + dyBH * dyBH;
-
-    if (d2BH < bh_r2) {
-        out_pixels[idx] = (uchar4)(0, 0, 0, 0);   // BGRA = black
+    if (sqrt(dxBH * dxBH + dyBH * dyBH) < bh_radius) {
+        out_pixels[y * width + x] = (uchar4)(0, 0, 0, 0);
         return;
     }
 
+    float r = 0.0f, g = 0.0f, b = 0.0f;
+    float weights = 0.0f, shortest = INFINITY;
+    for (int j = 0; j < sat_count; ++j) {
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float distance = sqrt(dx * dx + dy * dy);
+        if (distance < sat_radius) {
+            out_pixels[y * width + x] = (uchar4)(255, 255, 255, 0);
+            return;
+        }
+        weights += 1.0f / (distance * distance * distance * distance);
+        if (distance < shortest) {
+            shortest = distance;
+            r = id_r[j]; g = id_g[j]; b = id_b[j];
+        }
+    }
+    for (int j = 0; j < sat_count; ++j) {
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = dx * dx + dy * dy;
+        float w = 1.0f / (d2 * d2);
+        r += (id_r[j] * w / weights) * 3.0f;
+        g += (id_g[j] * w / weights) * 3.0f;
+        b += (id_b[j] * w / weights) * 3.0f;
+    }
+    out_pixels[y * width + x] = (uchar4)((uchar)(b * 255.0f), (uchar)(g * 255.0f), (uchar)(r * 255.0f), (uchar)0);
+}
+
+// Same result as shade, with the squared distances split into a per-column
+// dx^2 and a per-row dy^2 table. The work-group builds both tables in local
+// memory for `chunk` satellites at a time, so the inner loop reads two local
+// values and adds them instead of doing two subtractions and two products.
+// Work-items outside the image still help to fill the tables.
+__kernel void shade_table(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __local float*          l_dx2,           // chunk * local size 0
+    __local float*          l_dy2,           // chunk * local size 1
+    __local float4*         l_id,            // chunk
+    const int   chunk)
+{
+    const int lx = get_local_id(0), ly = get_local_id(1);
+    const int wx = get_local_size(0), wy = get_local_size(1);
+    const int lid = ly * wx + lx, lsize = wx * wy;
+    const int x0 = get_group_id(0) * wx, y0 = get_group_id(1) * wy;
+    const int x = x0 + lx, y = y0 + ly;
+
     float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
     float weights = 0.0f;
     float shortestD2 = INFINITY;
-    float nR = 0.0f, nG = 0.0f, nB = 0.0f;        // nearest id
+    float nR = 0.0f, nG = 0.0f, nB = 0.0f;
     int   hit = 0;
 
-    // Single-pass satellite loop
+    for (int base = 0; base < sat_count; base += chunk) {
+        const int n = min(chunk, sat_count - base);
+
+        barrier(CLK_LOCAL_MEM_FENCE);   // previous chunk fully consumed
+        for (int i = lid; i < n * wx; i += lsize) {
+            float dx = (float)(x0 + i % wx) - sat_pos_x[base + i / wx];
+            l_dx2[i] = dx * dx;
+        }
+        for (int i = lid; i < n * wy; i += lsize) {
+            float dy = (float)(y0 + i % wy) - sat_pos_y[base + i / wy];
+            l_dy2[i] = dy * dy;
+        }
+        for (int i = lid; i < n; i += lsize) {
+            l_id[i] = (float4)(id_r[base + i], id_g[base + i], id_b[base + i], 0.0f);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int j = 0; j < n; ++j) {
+            float d2 = l_dx2[j * wx + lx] + l_dy2[j * wy + ly];
+            hit |= d2 < sat_r2;
+
+            float inv = 1.0f / d2;
+            float w = inv * inv;
+            float4 id = l_id[j];
+            weights += w;
+            sumR += id.x * w;
+            sumG += id.y * w;
+            sumB += id.z * w;
+
+            if (d2 < shortestD2) {
+                shortestD2 = d2;
+                nR = id.x; nG = id.y; nB = id.z;
+            }
+        }
+    }
+
+    if (x >= width || y >= height) return;
+    const int idx = y * width + x;
+
+    float dxBH = (float)x - (float)mouse_x;
+    float dyBH = (float)y - (float)mouse_y;
+    if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+        out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+    } else if (hit) {
+        out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+    } else {
+        float invW = 1.0f / weights;
+        uchar ur = (uchar)((nR + 3.0f * (sumR * invW)) * 255.0f);
+        uchar ug = (uchar)((nG + 3.0f * (sumG * invW)) * 255.0f);
+        uchar ub = (uchar)((nB + 3.0f * (sumB * invW)) * 255.0f);
+        out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+    }
+}
+
+// Same result as shade, with the satellites staged through local memory.
+// The work-group copies `chunk` satellites at a time into l_sat as two
+// float4 each, (x, y, 0, 0) and (red, green, blue, 0), so every satellite is
+// read from global memory once per work-group instead of once per
+// work-item. Work-items outside the image still help with the copies.
+__kernel void shade_local(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __local float4*         l_sat,           // 2 * chunk
+    const int   chunk)
+{
+    const int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    const int lsize = get_local_size(0) * get_local_size(1);
+    const int x = get_global_id(0), y = get_global_id(1);
+    const float px = (float)x, py = (float)y;
+
+    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    float weights = 0.0f;
+    float shortestD2 = INFINITY;
+    float nR = 0.0f, nG = 0.0f, nB = 0.0f;
+    int   hit = 0;
+
+    for (int base = 0; base < sat_count; base += chunk) {
+        const int n = min(chunk, sat_count - base);
+
+        barrier(CLK_LOCAL_MEM_FENCE);   // previous chunk fully consumed
+        for (int i = lid; i < n; i += lsize) {
+            l_sat[2 * i] = (float4)(sat_pos_x[base + i], sat_pos_y[base + i], 0.0f, 0.0f);
+            l_sat[2 * i + 1] = (float4)(id_r[base + i], id_g[base + i], id_b[base + i], 0.0f);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int j = 0; j < n; ++j) {
+            float4 pos = l_sat[2 * j];
+            float dx = px - pos.x;
+            float dy = py - pos.y;
+            float d2 = dx * dx + dy * dy;
+            hit |= d2 < sat_r2;
+
+            float inv = 1.0f / d2;
+            float w = inv * inv;
+            float4 id = l_sat[2 * j + 1];
+            weights += w;
+            sumR += id.x * w;
+            sumG += id.y * w;
+            sumB += id.z * w;
+
+            if (d2 < shortestD2) {
+                shortestD2 = d2;
+                nR = id.x; nG = id.y; nB = id.z;
+            }
+        }
+    }
+
+    if (x >= width || y >= height) return;
+    const int idx = y * width + x;
+
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+        out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+    } else if (hit) {
+        out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+    } else {
+        float invW = 1.0f / weights;
+        uchar ur = (uchar)((nR + 3.0f * (sumR * invW)) * 255.0f);
+        uchar ug = (uchar)((nG + 3.0f * (sumG * invW)) * 255.0f);
+        uchar ub = (uchar)((nB + 3.0f * (sumB * invW)) * 255.0f);
+        out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+    }
+}
+
+// Same result as shade, reading the satellites from constant memory in the
+// float4 pairs of shade_local, packed by the host. The packed array must fit
+// CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE. The global arrays are passed as for
+// the other kernels but not read.
+__kernel void shade_constant(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __constant float4*      sats)            // 2 * sat_count
+{
+    const int x = get_global_id(0), y = get_global_id(1);
+    if (x >= width || y >= height) return;
+    const int idx = y * width + x;
+    const float px = (float)x, py = (float)y;
+
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+        out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+        return;
+    }
+
+    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    float weights = 0.0f;
+    float shortestD2 = INFINITY;
+    float nR = 0.0f, nG = 0.0f, nB = 0.0f;
+
+    for (int j = 0; j < sat_count; ++j) {
+        float4 pos = sats[2 * j];
+        float dx = px - pos.x;
+        float dy = py - pos.y;
+        float d2 = dx * dx + dy * dy;
+
+        if (d2 < sat_r2) {
+            out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+            return;
+        }
+
+        float inv = 1.0f / d2;
+        float w = inv * inv;
+        float4 id = sats[2 * j + 1];
+        weights += w;
+        sumR += id.x * w;
+        sumG += id.y * w;
+        sumB += id.z * w;
+
+        if (d2 < shortestD2) {
+            shortestD2 = d2;
+            nR = id.x; nG = id.y; nB = id.z;
+        }
+    }
+
+    float invW = 1.0f / weights;
+    uchar ur = (uchar)((nR + 3.0f * (sumR * invW)) * 255.0f);
+    uchar ug = (uchar)((nG + 3.0f * (sumG * invW)) * 255.0f);
+    uchar ub = (uchar)((nB + 3.0f * (sumB * invW)) * 255.0f);
+    out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+}
+
+// Pixels per work-item of shade_blocked, set by the host's build options
+#ifndef BLOCK_X
+#define BLOCK_X 4
+#endif
+#ifndef BLOCK_Y
+#define BLOCK_Y 1
+#endif
+#define BLOCK_PIXELS (BLOCK_X * BLOCK_Y)
+
+// Same result as shade, with every work-item shading the BLOCK_X x BLOCK_Y
+// pixels from (BLOCK_X * gid0, BLOCK_Y * gid1). Each satellite is loaded
+// once per block, and the per-pixel accumulators are private arrays indexed
+// only in unrolled loops, so they stay in registers. A hit marks its pixel
+// instead of leaving the loop; pixels past the image edge are computed but
+// not written.
+__kernel void shade_blocked(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y)
+{
+    const int x0 = get_global_id(0) * BLOCK_X;
+    const int y0 = get_global_id(1) * BLOCK_Y;
+    if (x0 >= width || y0 >= height) return;
+
+    float sumR[BLOCK_PIXELS], sumG[BLOCK_PIXELS], sumB[BLOCK_PIXELS];
+    float weights[BLOCK_PIXELS], shortestD2[BLOCK_PIXELS];
+    float nR[BLOCK_PIXELS], nG[BLOCK_PIXELS], nB[BLOCK_PIXELS];
+    int   hit[BLOCK_PIXELS];
+    #pragma unroll
+    for (int p = 0; p < BLOCK_PIXELS; ++p) {
+        sumR[p] = sumG[p] = sumB[p] = 0.0f;
+        weights[p] = 0.0f;
+        shortestD2[p] = INFINITY;
+        nR[p] = nG[p] = nB[p] = 0.0f;
+        hit[p] = 0;
+    }
+
+    for (int j = 0; j < sat_count; ++j) {
+        const float sx = sat_pos_x[j], sy = sat_pos_y[j];
+        const float ir = id_r[j], ig = id_g[j], ib = id_b[j];
+
+        #pragma unroll
+        for (int p = 0; p < BLOCK_PIXELS; ++p) {
+            float dx = (float)(x0 + p % BLOCK_X) - sx;
+            float dy = (float)(y0 + p / BLOCK_X) - sy;
+            float d2 = dx * dx + dy * dy;
+            hit[p] |= d2 < sat_r2;
+
+            float inv = 1.0f / d2;
+            float w = inv * inv;
+            weights[p] += w;
+            sumR[p] += ir * w;
+            sumG[p] += ig * w;
+            sumB[p] += ib * w;
+
+            if (d2 < shortestD2[p]) {
+                shortestD2[p] = d2;
+                nR[p] = ir; nG[p] = ig; nB[p] = ib;
+            }
+        }
+    }
+
+    #pragma unroll
+    for (int p = 0; p < BLOCK_PIXELS; ++p) {
+        const int x = x0 + p % BLOCK_X, y = y0 + p / BLOCK_X;
+        if (x >= width || y >= height) continue;
+        const int idx = y * width + x;
+
+        float dxBH = (float)x - (float)mouse_x;
+        float dyBH = (float)y - (float)mouse_y;
+        if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+            out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+        } else if (hit[p]) {
+            out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+        } else {
+            float invW = 1.0f / weights[p];
+            uchar ur = (uchar)((nR[p] + 3.0f * (sumR[p] * invW)) * 255.0f);
+            uchar ug = (uchar)((nG[p] + 3.0f * (sumG[p] * invW)) * 255.0f);
+            uchar ub = (uchar)((nB[p] + 3.0f * (sumB[p] * invW)) * 255.0f);
+            out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+        }
+    }
+}
+
+// Exact nearest-satellite index of every pixel. One work-group per tile;
+// the host lists per tile every satellite that can be nearest for one of
+// its pixels (CSR in tile_start / tile_cand, ascending index so ties resolve
+// like the full loop).
+__kernel void nearest_map(
+    __global int*           out_nearest,     // SIZE
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const int*     tile_start,      // tiles + 1
+    __global const int*     tile_cand,
+    const int   width,
+    const int   height)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    const int tile = get_group_id(1) * get_num_groups(0) + get_group_id(0);
+    const float px = (float)x;
+    const float py = (float)y;
+
+    float best = INFINITY;
+    int nearest = 0;
+    for (int c = tile_start[tile]; c < tile_start[tile + 1]; ++c) {
+        int j = tile_cand[c];
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = dx * dx + dy * dy;
+        if (d2 < best) { best = d2; nearest = j; }
+    }
+    out_nearest[y * width + x] = nearest;
+}
+
+// shade with the nearest satellite taken from nearest_map, so the satellite
+// loop only accumulates weights
+__kernel void shade_nearest(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __global const int*     nearest)         // SIZE, from nearest_map
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    const int   idx = y * width + x;
+    const float px = (float)x;
+    const float py = (float)y;
+
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+        out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+        return;
+    }
+
+    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    float weights = 0.0f;
     for (int j = 0; j < sat_count; ++j) {
         float dx = px - sat_pos_x[j];
         float dy = py - sat_pos_y[j];
         float d2 = dx * dx + dy * dy;
 
         if (d2 < sat_r2) {
-            out_pixels[idx] = (uchar4)(255, 255, 255, 0); // BGRA = white
-            hit = 1;
-            break;
+            out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+            return;
         }
 
         float inv = 1.0f / d2;
         float w = inv * inv;
         weights += w;
-
         sumR += id_r[j] * w;
         sumG += id_g[j] * w;
         sumB += id_b[j] * w;
+    }
 
-        if (d2 < shortestD2) {
-            shortestD2 = d2;
-            nR = id_r[j]; nG = id_g[j]; nB = id_b[j];
+    const int k = nearest[idx];
+    float invW = 1.0f / weights;
+    uchar ur = (uchar)((id_r[k] + 3.0f * (sumR * invW)) * 255.0f);
+    uchar ug = (uchar)((id_g[k] + 3.0f * (sumG * invW)) * 255.0f);
+    uchar ub = (uchar)((id_b[k] + 3.0f * (sumB * invW)) * 255.0f);
+    out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+}
+
+// shade with both searches on the satellite cell grid: the hit test only
+// scans the 3x3 cells around the pixel's cell (cell_size > satellite radius)
+// and the nearest satellite comes from the work-group's candidate list, so
+// the loop over all satellites only accumulates weights
+__kernel void shade_grid(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __global const int*     cell_start,      // cells_x * cells_y + 1
+    __global const int*     cell_list,       // satellites binned per cell
+    const int   cells_x,
+    const int   cells_y,
+    const int   cell_size,
+    __global const int*     tile_start,      // work-groups + 1
+    __global const int*     tile_cand)       // nearest candidates per work-group
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    const int   idx = y * width + x;
+    const float px = (float)x;
+    const float py = (float)y;
+
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    if (dxBH * dxBH + dyBH * dyBH < bh_r2) {
+        out_pixels[idx] = (uchar4)(0, 0, 0, 0);
+        return;
+    }
+
+    const int cx = min(x / cell_size, cells_x - 1);
+    const int cy = min(y / cell_size, cells_y - 1);
+    for (int ny = max(cy - 1, 0); ny <= min(cy + 1, cells_y - 1); ++ny) {
+        for (int nx = max(cx - 1, 0); nx <= min(cx + 1, cells_x - 1); ++nx) {
+            const int c = ny * cells_x + nx;
+            for (int s = cell_start[c]; s < cell_start[c + 1]; ++s) {
+                int j = cell_list[s];
+                float dx = px - sat_pos_x[j];
+                float dy = py - sat_pos_y[j];
+                if (dx * dx + dy * dy < sat_r2) {
+                    out_pixels[idx] = (uchar4)(255, 255, 255, 0);
+                    return;
+                }
+            }
         }
     }
 
-    if (!hit) {
-        float invW = 1.0f / weights;
-        float r = nR + 3.0f * (sumR * invW);
-        float g = nG + 3.0f * (sumG * invW);
-        float b = nB + 3.0f * (sumB * invW);
-
-        // Convert to BGRA 0..255
-        uchar ur = (uchar)(r * 255.0f);
-        uchar ug = (uchar)(g * 255.0f);
-        uchar ub = (uchar)(b * 255.0f);
-        out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+    const int tile = get_group_id(1) * get_num_groups(0) + get_group_id(0);
+    float best = INFINITY;
+    int nearest = 0;
+    for (int c = tile_start[tile]; c < tile_start[tile + 1]; ++c) {
+        int j = tile_cand[c];
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = dx * dx + dy * dy;
+        if (d2 < best) { best = d2; nearest = j; }
     }
+
+    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    float weights = 0.0f;
+    for (int j = 0; j < sat_count; ++j) {
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = dx * dx + dy * dy;
+        float inv = 1.0f / d2;
+        float w = inv * inv;
+        weights += w;
+        sumR += id_r[j] * w;
+        sumG += id_g[j] * w;
+        sumB += id_b[j] * w;
+    }
+
+    float invW = 1.0f / weights;
+    uchar ur = (uchar)((id_r[nearest] + 3.0f * (sumR * invW)) * 255.0f);
+    uchar ug = (uchar)((id_g[nearest] + 3.0f * (sumG * invW)) * 255.0f);
+    uchar ub = (uchar)((id_b[nearest] + 3.0f * (sumB * invW)) * 255.0f);
+    out_pixels[idx] = (uchar4)(ub, ug, ur, (uchar)0);
+}
+
+// First pass of the stamp renderer: shade without the hit test, so the
+// satellite loop has no branch. Pixels under a disc are overwritten by
+// stamp_discs; distances there are raised to 1 (below sat_r2) so the weights
+// stay finite and the colour converts to uchar in range. Same arguments as
+// shade; sat_r2 is not used.
+__kernel void shade_weights(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if (x >= width || y >= height) return;
+
+    const float px = (float)x;
+    const float py = (float)y;
+
+    float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f;
+    float weights = 0.0f;
+    float shortestD2 = INFINITY;
+    float nR = 0.0f, nG = 0.0f, nB = 0.0f;
+    for (int j = 0; j < sat_count; ++j) {
+        float dx = px - sat_pos_x[j];
+        float dy = py - sat_pos_y[j];
+        float d2 = fmax(dx * dx + dy * dy, 1.0f);
+
+        float inv = 1.0f / d2;
+        float w = inv * inv;
+        float r = id_r[j], g = id_g[j], b = id_b[j];
+        weights += w;
+        sumR += r * w;
+        sumG += g * w;
+        sumB += b * w;
+
+        int closer = d2 < shortestD2;
+        shortestD2 = closer ? d2 : shortestD2;
+        nR = closer ? r : nR;
+        nG = closer ? g : nG;
+        nB = closer ? b : nB;
+    }
+
+    float invW = 1.0f / weights;
+    uchar ur = (uchar)((nR + 3.0f * (sumR * invW)) * 255.0f);
+    uchar ug = (uchar)((nG + 3.0f * (sumG * invW)) * 255.0f);
+    uchar ub = (uchar)((nB + 3.0f * (sumB * invW)) * 255.0f);
+
+    float dxBH = px - (float)mouse_x;
+    float dyBH = py - (float)mouse_y;
+    uchar4 c = (uchar4)(ub, ug, ur, (uchar)0);
+    out_pixels[y * width + x] = dxBH * dxBH + dyBH * dyBH < bh_r2 ? (uchar4)(0, 0, 0, 0) : c;
+}
+
+// Second pass of the stamp renderer: one work-item per pixel of a
+// satellite's box x box bounding box (work-item j * box * box + k). Pixels
+// inside the disc and outside the black hole become white; overlapping
+// discs store the same value.
+__kernel void stamp_discs(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    const float sat_radius,
+    const int   box)                         // bounding box side in pixels
+{
+    const int gid = get_global_id(0);
+    const int j = gid / (box * box);
+    const int k = gid % (box * box);
+    if (j >= sat_count) return;
+
+    const float sx = sat_pos_x[j];
+    const float sy = sat_pos_y[j];
+    const int x = (int)ceil(sx - sat_radius) + k % box;
+    const int y = (int)ceil(sy - sat_radius) + k / box;
+    if (x < 0 || y < 0 || x >= width || y >= height) return;
+
+    float dx = (float)x - sx;
+    float dy = (float)y - sy;
+    float dxBH = (float)x - (float)mouse_x;
+    float dyBH = (float)y - (float)mouse_y;
+    if (dx * dx + dy * dy < sat_r2 && dxBH * dxBH + dyBH * dyBH >= bh_r2) {
+        out_pixels[y * width + x] = (uchar4)(255, 255, 255, 0);
+    }
+}
+
+// Progressive refinement pass. One work-group per tile, taken in priority
+// order from tile_order[tile_base + group]. Each work-item evaluates the
+// sample at (lx, ly) * step within the tile and fills the step x step block
+// it covers; samples on the previous (2 * step) lattice are already exact.
+__kernel void shade_progressive(
+    __global uchar4*        out_pixels,
+    __global const float*   sat_pos_x,
+    __global const float*   sat_pos_y,
+    __global const float*   id_r,
+    __global const float*   id_g,
+    __global const float*   id_b,
+    const int   sat_count,
+    const int   width,
+    const int   height,
+    const float bh_r2,
+    const float sat_r2,
+    const int   mouse_x,
+    const int   mouse_y,
+    __global const int*     tile_order,      // tile indices, nearest first
+    const int   tile_base,                   // first entry of this launch
+    const int   tile_size,
+    const int   tiles_x,
+    const int   step,                        // sample step of this pass
+    const int   coarsest)                    // sample step of the first pass
+{
+    const int tile = tile_order[tile_base + get_group_id(0)];
+    const int lx = get_local_id(0) * step;
+    const int ly = get_local_id(1) * step;
+    const int x = (tile % tiles_x) * tile_size + lx;
+    const int y = (tile / tiles_x) * tile_size + ly;
+
+    if (x >= width || y >= height) return;
+    if (step < coarsest && lx % (2 * step) == 0 && ly % (2 * step) == 0) return;
+
+    uchar4 c = shade_pixel(x, y, sat_pos_x, sat_pos_y, id_r, id_g, id_b,
+                           sat_count, bh_r2, sat_r2, mouse_x, mouse_y);
+    const int x1 = min(x + step, width);
+    const int y1 = min(y + step, height);
+    for (int by = y; by < y1; ++by)
+        for (int bx = x; bx < x1; ++bx)
+            out_pixels[by * width + bx] = c;
 }
\ No newline at end of file